@@ -0,0 +1,80 @@
+"""
+Make a synthetic tombll.db with many levels for benchmarking the launcher.
+
+The schema and the pictures are copied from the real tombll.db, every new
+level gets one of those pictures as cover plus a few more screens so the
+list and info queries see the same shape of data as the real database.
+
+Usage: python3 make_benchmark_database.py path/to/output/dir [level count]
+
+Then run the test binary with: TombRaiderLinuxLauncherTest -l path/to/output/dir
+"""
+import os
+import sys
+import random
+import logging
+import sqlite3
+
+SOURCE_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'tombll.db')
+
+
+def make_benchmark_database(output_dir, level_count):
+    """Write output_dir/tombll.db with level_count synthetic levels"""
+    os.makedirs(output_dir, exist_ok=True)
+    output_path = os.path.join(output_dir, 'tombll.db')
+    if os.path.exists(output_path):
+        os.remove(output_path)
+
+    source = sqlite3.connect(SOURCE_PATH)
+    pictures = [row[0] for row in source.execute('SELECT data FROM Picture')]
+    schema = [row[0] for row in source.execute(
+        "SELECT sql FROM sqlite_master WHERE type='table' AND sql IS NOT NULL "
+        "AND name != 'sqlite_sequence'")]
+    source.close()
+
+    connection = sqlite3.connect(output_path)
+    cursor = connection.cursor()
+    for sql in schema:
+        cursor.execute(sql)
+
+    rng = random.Random(1996)
+    months = ['Jan', 'Feb', 'Mar', 'Apr', 'May', 'Jun',
+              'Jul', 'Aug', 'Sep', 'Oct', 'Nov', 'Dec']
+
+    for level in range(1, level_count + 1):
+        release = f"{rng.randint(1, 28):02d}-{rng.choice(months)}-{rng.randint(1999, 2024)}"
+        cursor.execute(
+            "INSERT INTO Info (title, release, difficulty, duration, type, class) "
+            "VALUES (?, ?, ?, ?, ?, ?)",
+            (f"Benchmark Level {level}", release, rng.randint(1, 4),
+             rng.randint(1, 4), rng.randint(1, 5), rng.randint(1, 35)))
+        info_id = cursor.lastrowid
+        cursor.execute(
+            "INSERT INTO Level (body, walkthrough, infoID) VALUES (?, ?, ?)",
+            (f"<p>Body of level {level}</p>", "", info_id))
+        level_id = cursor.lastrowid
+
+        cursor.execute("INSERT OR IGNORE INTO Author (value) VALUES (?)",
+                       (f"Author {level % 700}",))
+        cursor.execute("SELECT AuthorID FROM Author WHERE value = ?",
+                       (f"Author {level % 700}",))
+        cursor.execute("INSERT INTO AuthorList (authorID, levelID) VALUES (?, ?)",
+                       (cursor.fetchone()[0], level_id))
+
+        for _ in range(3):
+            cursor.execute("INSERT INTO Picture (data) VALUES (?)",
+                           (rng.choice(pictures),))
+            cursor.execute("INSERT INTO Screens (pictureID, levelID) VALUES (?, ?)",
+                           (cursor.lastrowid, level_id))
+
+    connection.commit()
+    connection.close()
+
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (2, 3):
+        logging.error("Usage: python3 make_benchmark_database.py path/to/dir [count]")
+        sys.exit(1)
+    else:
+        COUNT = int(sys.argv[2]) if len(sys.argv) == 3 else 5000
+        make_benchmark_database(os.path.abspath(sys.argv[1]), COUNT)
@@ -15,6 +15,7 @@
 #include <QDebug>
 
 Controller::Controller() : controllerThread(new QThread()) {
+    qRegisterMetaType<QVector<ListItemData>>("QVector<ListItemData>");
     initializeThread();
 }
 
@@ -72,6 +73,18 @@ void Controller::initializeThread() {
             this, [this](const QList<int>& availableGames) {
         emit controllerGenerateList(availableGames);
     }, Qt::QueuedConnection);
+
+    // The list batches come from the decode pool while the controller
+    // thread waits on it, pass them on directly to reach the GUI in time
+    connect(&model, &Model::listBatchSignal,
+            this, [this](const QVector<ListItemData>& list) {
+        emit controllerListBatch(list);
+    }, Qt::DirectConnection);
+
+    connect(&model, &Model::listDoneSignal,
+            this, [this]() {
+        emit controllerListDone();
+    }, Qt::DirectConnection);
 }
 
 void Controller::checkCommonFiles() {
@@ -95,10 +108,6 @@ int Controller::checkGameDirectory(int id) {
     return model.checkGameDirectory(id);
 }
 
-void Controller::getList(QVector<ListItemData>* list) {
-    model.getList(list);
-}
-
 const InfoData Controller::getInfo(int id) {
     return model.getInfo(id);
 }
@@ -107,6 +116,10 @@ const QString Controller::getWalkthrough(int id) {
     return model.getWalkthrough(id);
 }
 
+QVector<qint64> Controller::searchLevels(const QString& text, int field) {
+    return model.searchLevels(text, field);
+}
+
 bool Controller::link(int id) {
     return model.setLink(id);
 }
@@ -37,14 +37,16 @@ class Controller : public QObject {
     void setupGame(int id);
     void setupLevel(int id);
 
-    void getList(QVector<ListItemData>* list);
     const InfoData getInfo(int id);
     const QString getWalkthrough(int id);
+    QVector<qint64> searchLevels(const QString& text, int field);
     bool link(int id);
     int getItemState(int id);
 
  signals:
     void controllerGenerateList(const QList<int>& availableGames);
+    void controllerListBatch(const QVector<ListItemData>& list);
+    void controllerListDone();
     void controllerTickSignal();
     void controllerDownloadError(int status);
 
@@ -12,12 +12,104 @@
  */
 
 #include "Data.hpp"
+#include <QRegularExpression>
+
+static QAtomicInt connectionCounter;
+
+DatabaseConnection::~DatabaseConnection() {
+    // Every query has to be gone before the connection can be removed
+    m_queries.clear();
+    QSqlDatabase::database(m_name, false).close();
+    QSqlDatabase::removeDatabase(m_name);
+}
+
+bool Data::initializeDatabase(const QString& path) {
+    bool status = false;
+    const QString filePath = QString("%1/%2").arg(path, "tombll.db");
+    QFileInfo fileInfo(filePath);
+
+    // Open the file
+    if (!fileInfo.exists() || !fileInfo.isFile()) {
+        qCritical()
+            << "Error: The database path is not a regular file: " << path;
+        status = false;
+    } else {
+        {
+            // Connections made for an older path are replaced on next use
+            QWriteLocker locker(&m_lock);
+            m_databasePath = filePath;
+            (void)m_generation.fetchAndAddOrdered(1);
+        }
+        QReadLocker locker(&m_lock);
+        status = (connection() != nullptr);
+    }
+    return status;
+}
+
+void Data::releaseDatabase() {
+    // Only the connection of the calling thread, the others are
+    // removed when their thread exits
+    m_connections.setLocalData(nullptr);
+}
+
+DatabaseConnection* Data::connection() {
+    DatabaseConnection* current = m_connections.localData();
+    const int generation = m_generation.loadAcquire();
+
+    if ((current == nullptr) || (current->m_generation != generation)) {
+        const QString name = QString("tombll_%1")
+            .arg(connectionCounter.fetchAndAddOrdered(1));
+        bool opened = false;
+        {
+            QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+            db.setDatabaseName(m_databasePath);
+            opened = db.open();  // flawfinder: ignore
+            if (opened == false) {
+                qDebug() << "Error opening database:" << db.lastError().text();
+            }
+        }
+        // Deletes the old connection of this thread
+        current = new DatabaseConnection(name, generation);
+        m_connections.setLocalData(current);
+        if (opened == false) {
+            m_connections.setLocalData(nullptr);
+            current = nullptr;
+        }
+    }
+    return current;
+}
+
+bool Data::prepareQuery(const QString& sql, QSqlQuery* query) {
+    bool status = false;
+    DatabaseConnection* current = connection();
+
+    if (current != nullptr) {
+        auto it = current->m_queries.constFind(sql);
+        if (it != current->m_queries.constEnd()) {
+            *query = it.value();
+            status = true;
+        } else {
+            QSqlQuery prepared(QSqlDatabase::database(current->m_name, false));
+            prepared.setForwardOnly(true);
+            if (prepared.prepare(sql) == true) {
+                current->m_queries.insert(sql, prepared);
+                *query = prepared;
+                status = true;
+            } else {
+                qDebug() << "Error preparing query:"
+                    << prepared.lastError().text();
+            }
+        }
+    }
+    return status;
+}
 
 qint64 Data::getListRowCount() {
-    QSqlQuery query(db);
+    QReadLocker locker(&m_lock);
+    QSqlQuery query;
     qint64 result = 0;
 
-    if (query.prepare("SELECT COUNT(*) FROM Level") == true) {
+    if (prepareQuery("SELECT COUNT(*) FROM Level", &query) == true) {
         if (query.exec() == true) {
             // Move to the first (and only) result row
             if (query.next() == true) {
@@ -30,70 +122,93 @@ qint64 Data::getListRowCount() {
         } else {
             qDebug() << "Error executing query:" << query.lastError().text();
         }
-    } else {
-        qDebug() << "Error preparing query:" << query.lastError().text();
+        query.finish();
     }
     return result;
 }
 
 QVector<ListItemData> Data::getListItems() {
-    QSqlQuery query(db);
-    bool status = true;
     QVector<ListItemData> items;
-    qint64 rowCount = getListRowCount();
+    getListItems(256, [&items](const QVector<ListItemData>& batch) {
+        items.append(batch);
+    });
+    return items;
+}
 
-    if (!query.prepare(
-            "SELECT Info.title, Author.value, Info.type, "
-            "Info.class, Info.release, Info.difficulty, "
-            "Info.duration, Picture.data FROM Level "
-            "JOIN Info ON Level.infoID = Info.InfoID "
-            "JOIN Screens ON Level.LevelID = Screens.levelID "
-            "JOIN Picture ON Screens.pictureID = Picture.PictureID "
-            "JOIN AuthorList ON Level.LevelID = AuthorList.levelID "
-            "JOIN Author ON AuthorList.authorID = Author.AuthorID "
-            "WHERE Level.LevelID = :id "
-            "GROUP BY Level.LevelID "
-            "ORDER BY MIN(Picture.PictureID) ASC")) {
-        qDebug() << "Error preparing query:" << query.lastError().text();
-        status = false;
-    }
+void Data::getListItems(
+        qint64 batchSize,
+        const std::function<void(const QVector<ListItemData>&)>& batchReady) {
+    QReadLocker locker(&m_lock);
+    QSqlQuery query;
+    QVector<ListItemData> items;
+    items.reserve(batchSize);
 
-    if (status) {
-        for (qint64 i = 1; i <= rowCount; i++) {
-            query.bindValue(":id", i);  // Bind the current LevelID
-            if (query.exec() == true) {
-                while (query.next() == true) {
-                    items.append(ListItemData(
-                        query.value("Info.title").toString(),
-                        query.value("Author.value").toString(),
-                        query.value("Info.type").toInt(),
-                        query.value("Info.class").toInt(),
-                        query.value("Info.release").toString(),
-                        query.value("Info.difficulty").toInt(),
-                        query.value("Info.duration").toInt(),
-                        query.value("Picture.data").toByteArray()));
-                }
-            } else {
-                qDebug() << "Error executing query for Level ID:" << i
-                         << query.lastError().text();
+    // One pass over Level, authors and covers are grouped once up front
+    // instead of per level. The cover is the screen with the lowest
+    // PictureID. Levels without authors or screens are kept with empty values.
+    if (!prepareQuery(
+            "SELECT Level.LevelID, Info.title, Info.type, Info.class, "
+            "Info.release, Info.difficulty, Info.duration, "
+            "Authors.value, Picture.PictureID, Picture.data "
+            "FROM Level "
+            "JOIN Info ON Level.infoID = Info.InfoID "
+            "LEFT JOIN ("
+            "    SELECT AuthorList.levelID AS levelID, "
+            "    group_concat(Author.value, ', ') AS value "
+            "    FROM AuthorList "
+            "    JOIN Author ON AuthorList.authorID = Author.AuthorID "
+            "    GROUP BY AuthorList.levelID"
+            ") AS Authors ON Authors.levelID = Level.LevelID "
+            "LEFT JOIN ("
+            "    SELECT Screens.levelID AS levelID, "
+            "    MIN(Screens.pictureID) AS pictureID "
+            "    FROM Screens "
+            "    GROUP BY Screens.levelID"
+            ") AS Cover ON Cover.levelID = Level.LevelID "
+            "LEFT JOIN Picture ON Picture.PictureID = Cover.pictureID "
+            "ORDER BY Level.LevelID ASC", &query)) {
+        qDebug() << "List query is not available";
+    } else if (query.exec() == true) {
+        while (query.next() == true) {
+            items.append(ListItemData(
+                query.value(0).toLongLong(),
+                query.value(1).toString(),
+                query.value(7).toString(),
+                query.value(2).toInt(),
+                query.value(3).toInt(),
+                query.value(4).toString(),
+                query.value(5).toInt(),
+                query.value(6).toInt(),
+                query.value(8).toLongLong(),
+                query.value(9).toByteArray()));
+            if (items.size() >= batchSize) {
+                batchReady(items);
+                items.clear();
             }
         }
+        if (items.isEmpty() == false) {
+            batchReady(items);
+        }
+        query.finish();
+    } else {
+        qDebug() << "Error executing query:" << query.lastError().text();
     }
-    return items;
 }
 
 InfoData Data::getInfo(const int id) {
-    QSqlQuery query(db);
+    QReadLocker locker(&m_lock);
+    QSqlQuery query;
     bool status = false;
+    QVector<qint64> pictureIdList;
     QVector<QByteArray> imageList;
     InfoData result;
 
-    status = query.prepare(
-        "SELECT Level.body, Picture.data "
+    status = prepareQuery(
+        "SELECT Level.body, Picture.PictureID, Picture.data "
         "FROM Level "
         "JOIN Screens ON Level.LevelID = Screens.levelID "
         "JOIN Picture ON Screens.pictureID = Picture.PictureID "
-        "WHERE Level.LevelID = :id");
+        "WHERE Level.LevelID = :id", &query);
     query.bindValue(":id", id);
 
     if (status) {
@@ -103,27 +218,31 @@ InfoData Data::getInfo(const int id) {
                 // notice that we jump over the fist image
                 // the first image is the cover image
                 while (query.next() == true) {
+                    pictureIdList.push_back(
+                        query.value("Picture.PictureID").toLongLong());
                     imageList.push_back(
                         query.value("Picture.data").toByteArray());
                 }
-                result = InfoData(body, imageList);
+                result = InfoData(body, pictureIdList, imageList);
             }
         } else {
             qDebug() << "Error executing query:" << query.lastError().text();
         }
+        query.finish();
     }
     return result;
 }
 
 QString Data::getWalkthrough(const int id) {
-    QSqlQuery query(db);
+    QReadLocker locker(&m_lock);
+    QSqlQuery query;
     bool status = false;
     QString result = "";
 
-    status = query.prepare(
+    status = prepareQuery(
         "SELECT Level.walkthrough "
         "FROM Level "
-        "WHERE Level.LevelID = :id");
+        "WHERE Level.LevelID = :id", &query);
     query.bindValue(":id", id);
 
     if (status) {
@@ -136,20 +255,22 @@ QString Data::getWalkthrough(const int id) {
         } else {
             qDebug() << "Error executing query:" << query.lastError().text();
         }
+        query.finish();
     }
     return result;
 }
 
 int Data::getType(const int id) {
-    QSqlQuery query(db);
+    QReadLocker locker(&m_lock);
+    QSqlQuery query;
     bool status = false;
     int result = 0;
 
-    status = query.prepare(
+    status = prepareQuery(
         "SELECT Info.type "
         "FROM Level "
         "JOIN Info ON Level.infoID = Info.InfoID "
-        "WHERE Level.LevelID = :id");
+        "WHERE Level.LevelID = :id", &query);
     query.bindValue(":id", id);
 
     if (status) {
@@ -162,21 +283,23 @@ int Data::getType(const int id) {
         } else {
             qDebug() << "Error executing query:" << query.lastError().text();
         }
+        query.finish();
     }
     return result;
 }
 
 ZipData Data::getDownload(const int id) {
-    QSqlQuery query(db);
+    QReadLocker locker(&m_lock);
+    QSqlQuery query;
     bool status = false;
     ZipData result;
 
-    status = query.prepare(
+    status = prepareQuery(
         "SELECT Zip.* "
         "FROM Level "
         "JOIN ZipList ON Level.LevelID = ZipList.levelID "
         "JOIN Zip ON ZipList.zipID = Zip.ZipID "
-        "WHERE Level.LevelID = :id");
+        "WHERE Level.LevelID = :id", &query);
     query.bindValue(":id", id);
 
     if (status) {
@@ -195,22 +318,25 @@ ZipData Data::getDownload(const int id) {
         } else {
             qDebug() << "Error executing query:" << query.lastError().text();
         }
+        query.finish();
     }
     return result;
 }
 
 void Data::setDownloadMd5(const int id, const QString& newMd5sum) {
     bool status = false;
-    QSqlQuery query(db);
+    // A writer, it waits for the readers and runs alone
+    QWriteLocker locker(&m_lock);
+    QSqlQuery query;
 
-    status = query.prepare(
+    status = prepareQuery(
         "UPDATE Zip "
         "SET md5sum = :newMd5sum "
         "WHERE Zip.ZipID IN ("
         "    SELECT ZipList.zipID"
         "    FROM Level"
         "    JOIN ZipList ON Level.LevelID = ZipList.levelID"
-        "    WHERE Level.LevelID = :id)");
+        "    WHERE Level.LevelID = :id)", &query);
 
     if (status) {
         query.bindValue(":newMd5sum", newMd5sum);
@@ -221,32 +347,212 @@ void Data::setDownloadMd5(const int id, const QString& newMd5sum) {
         } else {
             qDebug() << "md5sum updated successfully.";
         }
-    } else {
-        qDebug() << "Error preparing query:" << query.lastError().text();
+        query.finish();
     }
 }
 
 QVector<FileList> Data::getFileList(const int id) {
-    QSqlQuery query(db);
+    QReadLocker locker(&m_lock);
+    QSqlQuery query;
     QVector<FileList> list;
 
-    if (!query.prepare(
+    if (prepareQuery(
             "SELECT File.path, File.md5sum "
             "FROM File "
             "JOIN GameFileList ON File.FileID = GameFileList.fileID "
-            "WHERE GameFileList.gameID = :id")) {
-        qDebug() << "Error preparing query:" << query.lastError().text();
-    }
-    query.bindValue(":id", id);
+            "WHERE GameFileList.gameID = :id", &query) == true) {
+        query.bindValue(":id", id);
 
-    if (query.exec() == true) {
-        while (query.next() == true) {
-            list.append({
-                query.value("path").toString(),
-                query.value("md5sum").toString()});
+        if (query.exec() == true) {
+            while (query.next() == true) {
+                list.append({
+                    query.value("path").toString(),
+                    query.value("md5sum").toString()});
+            }
+        } else {
+            qDebug() << "Error executing query:" << query.lastError().text();
         }
-    } else {
-        qDebug() << "Error executing query:" << query.lastError().text();
+        query.finish();
     }
     return list;
 }
+
+QString Data::searchExpression(const QString& text, const int field) {
+    QStringList terms;
+    const QStringList words = text.split(
+        QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+
+    // Quote each word so FTS5 operators typed by the user are just text
+    for (QString word : words) {
+        word.replace("\"", "\"\"");
+        terms.append(QString("\"%1\"*").arg(word));
+    }
+
+    QString expression;
+    if (terms.isEmpty() == false) {
+        const QString columns =
+            (field == 1) ? "author" : "{title body walkthrough}";
+        expression = QString("%1 : (%2)").arg(columns, terms.join(" "));
+    }
+    return expression;
+}
+
+// Bumped when the index or the triggers below change, the index is then
+// built again from scratch
+static const char SEARCH_INDEX_VERSION[] = "triggers 1";
+
+// The index and the triggers that note every level whose text changes
+static const char* const SEARCH_INDEX_SCHEMA[] = {
+    "CREATE VIRTUAL TABLE IF NOT EXISTS LevelSearch "
+    "USING fts5(title, author, body, walkthrough, "
+    "tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3')",
+    "CREATE TABLE IF NOT EXISTS LevelSearchState ("
+    "fingerprint TEXT NOT NULL)",
+    "CREATE TABLE IF NOT EXISTS LevelSearchDirty ("
+    "levelID INTEGER PRIMARY KEY)",
+    "CREATE TRIGGER IF NOT EXISTS LevelSearchLevelInsert "
+    "AFTER INSERT ON Level BEGIN "
+    "INSERT OR IGNORE INTO LevelSearchDirty VALUES (NEW.LevelID); END",
+    "CREATE TRIGGER IF NOT EXISTS LevelSearchLevelUpdate "
+    "AFTER UPDATE ON Level BEGIN "
+    "INSERT OR IGNORE INTO LevelSearchDirty "
+    "VALUES (OLD.LevelID), (NEW.LevelID); END",
+    "CREATE TRIGGER IF NOT EXISTS LevelSearchLevelDelete "
+    "AFTER DELETE ON Level BEGIN "
+    "INSERT OR IGNORE INTO LevelSearchDirty VALUES (OLD.LevelID); END",
+    "CREATE TRIGGER IF NOT EXISTS LevelSearchInfoUpdate "
+    "AFTER UPDATE ON Info BEGIN "
+    "INSERT OR IGNORE INTO LevelSearchDirty SELECT LevelID FROM Level "
+    "WHERE infoID IN (OLD.InfoID, NEW.InfoID); END",
+    "CREATE TRIGGER IF NOT EXISTS LevelSearchInfoDelete "
+    "AFTER DELETE ON Info BEGIN "
+    "INSERT OR IGNORE INTO LevelSearchDirty SELECT LevelID FROM Level "
+    "WHERE infoID = OLD.InfoID; END",
+    "CREATE TRIGGER IF NOT EXISTS LevelSearchAuthorUpdate "
+    "AFTER UPDATE ON Author BEGIN "
+    "INSERT OR IGNORE INTO LevelSearchDirty SELECT levelID FROM AuthorList "
+    "WHERE authorID IN (OLD.AuthorID, NEW.AuthorID); END",
+    "CREATE TRIGGER IF NOT EXISTS LevelSearchAuthorDelete "
+    "AFTER DELETE ON Author BEGIN "
+    "INSERT OR IGNORE INTO LevelSearchDirty SELECT levelID FROM AuthorList "
+    "WHERE authorID = OLD.AuthorID; END",
+    "CREATE TRIGGER IF NOT EXISTS LevelSearchAuthorListInsert "
+    "AFTER INSERT ON AuthorList BEGIN "
+    "INSERT OR IGNORE INTO LevelSearchDirty VALUES (NEW.levelID); END",
+    "CREATE TRIGGER IF NOT EXISTS LevelSearchAuthorListUpdate "
+    "AFTER UPDATE ON AuthorList BEGIN "
+    "INSERT OR IGNORE INTO LevelSearchDirty "
+    "VALUES (OLD.levelID), (NEW.levelID); END",
+    "CREATE TRIGGER IF NOT EXISTS LevelSearchAuthorListDelete "
+    "AFTER DELETE ON AuthorList BEGIN "
+    "INSERT OR IGNORE INTO LevelSearchDirty VALUES (OLD.levelID); END",
+};
+
+bool Data::updateSearchIndex() {
+    // Rebuilding writes to tombll.db, the readers wait until it is done
+    QWriteLocker locker(&m_lock);
+    bool status = false;
+    DatabaseConnection* current = connection();
+
+    if (current != nullptr) {
+        QSqlDatabase db = QSqlDatabase::database(current->m_name, false);
+        QSqlQuery query(db);
+        QString stored;
+        qint64 dirty = 0;
+
+        // The triggers are made in the same transaction as the first
+        // build, so no edit is missed between them
+        status = db.transaction();
+        for (const char* statement : SEARCH_INDEX_SCHEMA) {
+            status = status && query.exec(statement);
+        }
+        if ((status == true) &&
+                query.exec("SELECT fingerprint FROM LevelSearchState") &&
+                query.next()) {
+            stored = query.value(0).toString();
+        }
+        if ((status == true) &&
+                query.exec("SELECT COUNT(*) FROM LevelSearchDirty") &&
+                query.next()) {
+            dirty = query.value(0).toLongLong();
+        }
+
+        const QString insert =
+            "INSERT INTO LevelSearch"
+            "(rowid, title, author, body, walkthrough) "
+            "SELECT Level.LevelID, Info.title, "
+            "COALESCE(Authors.value, ''), "
+            "Level.body, Level.walkthrough "
+            "FROM Level "
+            "JOIN Info ON Level.infoID = Info.InfoID "
+            "LEFT JOIN ("
+            "    SELECT AuthorList.levelID AS levelID, "
+            "    group_concat(Author.value, ' ') AS value "
+            "    FROM AuthorList "
+            "    JOIN Author ON AuthorList.authorID = Author.AuthorID "
+            "    GROUP BY AuthorList.levelID"
+            ") AS Authors ON Authors.levelID = Level.LevelID";
+
+        if ((status == true) && (stored != SEARCH_INDEX_VERSION)) {
+            qDebug() << "Building the search index";
+            status = query.exec("DELETE FROM LevelSearch") &&
+                query.exec(insert) &&
+                query.exec(
+                    "INSERT INTO LevelSearch(LevelSearch) "
+                    "VALUES('optimize')") &&
+                query.exec("DELETE FROM LevelSearchDirty") &&
+                query.exec("DELETE FROM LevelSearchState") &&
+                query.prepare(
+                    "INSERT INTO LevelSearchState (fingerprint) "
+                    "VALUES (:fingerprint)");
+            if (status == true) {
+                query.bindValue(":fingerprint", SEARCH_INDEX_VERSION);
+                status = query.exec();
+            }
+        } else if ((status == true) && (dirty > 0)) {
+            // Only the levels the triggers noted are indexed again
+            qDebug() << "Updating the search index for" << dirty << "levels";
+            status = query.exec(
+                    "DELETE FROM LevelSearch WHERE rowid IN "
+                    "(SELECT levelID FROM LevelSearchDirty)") &&
+                query.exec(insert + " WHERE Level.LevelID IN "
+                    "(SELECT levelID FROM LevelSearchDirty)") &&
+                query.exec("DELETE FROM LevelSearchDirty");
+        }
+
+        if (status == true) {
+            status = db.commit();
+        } else {
+            qDebug() << "Error updating search index:"
+                << query.lastError().text();
+            (void)db.rollback();
+        }
+        query.finish();
+    }
+    return status;
+}
+
+QVector<qint64> Data::searchLevels(const QString& text, const int field) {
+    QReadLocker locker(&m_lock);
+    QSqlQuery query;
+    QVector<qint64> result;
+    const QString expression = searchExpression(text, field);
+
+    // Hits in the title count most, then authors, body and walkthrough
+    if ((expression.isEmpty() == false) && prepareQuery(
+            "SELECT rowid FROM LevelSearch "
+            "WHERE LevelSearch MATCH :expression "
+            "ORDER BY bm25(LevelSearch, 10.0, 5.0, 1.0, 0.5)", &query)) {
+        query.bindValue(":expression", expression);
+
+        if (query.exec() == true) {
+            while (query.next() == true) {
+                result.append(query.value(0).toLongLong());
+            }
+        } else {
+            qDebug() << "Error executing query:" << query.lastError().text();
+        }
+        query.finish();
+    }
+    return result;
+}
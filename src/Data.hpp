@@ -14,16 +14,21 @@
 #ifndef SRC_DATA_HPP_
 #define SRC_DATA_HPP_
 
+#include <QAtomicInt>
 #include <QDebug>
 #include <QFileInfo>
+#include <QHash>
 #include <QIcon>
 #include <QObject>
-#include <QPainter>
 #include <QPixmap>
+#include <QReadWriteLock>
 #include <QSize>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QSqlQuery>
+#include <QThreadStorage>
+#include <functional>
+#include "ThumbnailCache.hpp"
 
 struct FileList {
     QString path;
@@ -88,12 +93,11 @@ struct ListItemData {
     /**
      * @brief Parameterized constructor for `ListItemData`.
      *
-     * This constructor initializes a `ListItemData` object with metadata and a cover image.
-     * The image is converted from raw `QByteArray` to a `QIcon` after scaling it to
-     * fit within 640x480 dimensions. The scaling maintains the aspect ratio and
-     * smooths out pixels using `Qt::SmoothTransformation`. The image is centered
-     * within a transparent background if its aspect ratio does not perfectly match the target.
+     * This constructor initializes a `ListItemData` object with metadata and the
+     * encoded cover image. The cover is not decoded here, call `decodePicture` for
+     * that, so the decoding can be done on a worker thread.
      *
+     * @param id The `Level.LevelID` this card belongs to.
      * @param title The TRLE title. Expected to contain a single name.
      * @param author The TRLE author(s). Can be a single name or multiple names separated by commas and spaces.
      * @param type The TRLE type, represented by a numeric ID.
@@ -101,50 +105,42 @@ struct ListItemData {
      * @param releaseDate The release date in the format "DD-MMM-YYYY" (e.g., "01-Jan-2000").
      * @param difficulty The TRLE difficulty, represented by a numeric ID.
      * @param duration The TRLE duration, represented by a numeric ID.
+     * @param pictureId The `Picture.PictureID` of the cover, used as thumbnail cache key.
      * @param imageData The cover image as a `QByteArray`. Supported formats include JPEG, PNG, and WEBP.
      */
     ListItemData(
-        const QString& title, const QString& author, qint64 type,
+        qint64 id, const QString& title, const QString& author, qint64 type,
         qint64 classInput, const QString& releaseDate, qint64 difficulty,
-        qint64 duration, QByteArray imageData) :
-        m_title(title), m_author(author), m_type(type),
+        qint64 duration, qint64 pictureId, QByteArray imageData) :
+        m_id(id), m_title(title), m_author(author), m_type(type),
         m_class(classInput), m_releaseDate(releaseDate),
-        m_difficulty(difficulty), m_duration(duration) {
-        // Load the image from the byte array
-        QPixmap pixmap;
-        pixmap.loadFromData(imageData, "WEBP");
+        m_difficulty(difficulty), m_duration(duration),
+        m_pictureId(pictureId), m_imageData(imageData) {}
 
-        // Define target dimensions and maintain aspect ratio
-        QSize targetSize(640, 480);
-        QSize newSize = pixmap.size().scaled(targetSize, Qt::KeepAspectRatio);
-
-        // Scale the pixmap
-        QPixmap scaledPixmap = pixmap.scaled(
-            newSize,
-            Qt::KeepAspectRatio,
-            Qt::SmoothTransformation);
-
-        // Create a centered pixmap with a transparent background
-        QPixmap centeredPixmap(targetSize);
-        // Ensure a transparent background
-        centeredPixmap.fill(Qt::transparent);
-
-        // Calculate offsets for centering the scaled image
-        qint64 xOffset = (targetSize.width() - newSize.width()) / 2;
-        qint64 yOffset = (targetSize.height() - newSize.height()) / 2;
-
-        // Draw the scaled image onto the centered pixmap
-        QPainter painter(&centeredPixmap);
-        painter.setRenderHint(QPainter::Antialiasing, true);
-        painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
-        painter.drawPixmap(xOffset, yOffset, scaledPixmap);
-        painter.end();
+    /**
+     * @brief Size the cards are decoded and cached at, as the list shows them.
+     */
+    static QSize coverSize() { return QSize(320, 240); }
 
-        // Store the resulting pixmap in a QIcon
-        m_picture.addPixmap(centeredPixmap);
+    /**
+     * @brief Decode the cover image to card size.
+     *
+     * The image is decoded directly at a size that fits within `coverSize`, see
+     * `decodeScaledImage`. The aspect ratio is maintained and the image is centered
+     * within a transparent background if it does not perfectly match the target.
+     * A card already in the `ThumbnailCache` is mapped instead of decoded.
+     * Only `QImage` is used so this is safe to call from any thread. The encoded
+     * data is released afterwards.
+     */
+    void decodePicture() {
+        m_pictureHash = ThumbnailCache::contentHash(m_imageData);
+        m_picture = ThumbnailCache::getInstance().getImage(
+            m_pictureId, m_pictureHash, m_imageData, coverSize());
+        m_imageData.clear();
     }
 
     // Data members
+    qint64 m_id;             ///< The `Level.LevelID` of the record.
     QString m_title;         ///< The TRLE level title.
     QString m_author;        ///< The TRLE author(s), as a string.
     qint64 m_type;           ///< ID of the type of level.
@@ -152,9 +148,14 @@ struct ListItemData {
     QString m_releaseDate;   ///< The release date in "DD-MMM-YYYY" format.
     qint64 m_difficulty;     ///< ID of the difficulty of the level.
     qint64 m_duration;       ///< ID of the estimated duration of the level.
-    QIcon m_picture;         ///< The cover image.
+    qint64 m_pictureId;      ///< The `Picture.PictureID` of the cover.
+    QByteArray m_imageData;  ///< The encoded cover image until it is decoded.
+    QByteArray m_pictureHash;  ///< MD5 of the encoded cover, set when decoded.
+    QImage m_picture;        ///< The cover image, decoded to card size.
 };
 
+Q_DECLARE_METATYPE(ListItemData)
+
 /**
  * @struct InfoData
  * @brief Store HTML data and a list of icons generated from image WEBP data.
@@ -175,22 +176,25 @@ struct InfoData {
      * @brief Constructs an `InfoData` object with the given body and image list.
      *
      * Converts each image in the provided `QVector<QByteArray>` to a `QIcon` object
-     * using the "WEBP" format and stores them in the icon list.
+     * scaled to the 502x377 info view size and stores them in the icon list.
+     * Images already in the `ThumbnailCache` are mapped instead of decoded.
      *
      * @param body A string representing the main textual content.
+     * @param pictureIdList The `Picture.PictureID` of each image.
      * @param imageList A vector of image data in `QByteArray` format.
      */
-    InfoData(const QString& body, const QVector<QByteArray>& imageList)
+    InfoData(const QString& body, const QVector<qint64>& pictureIdList,
+            const QVector<QByteArray>& imageList)
         : m_body(body) {
-        for (const QByteArray& image : imageList) {
-            QPixmap pixmap;
+        ThumbnailCache& cache = ThumbnailCache::getInstance();
+        const qint64 s = imageList.size();
+        for (qint64 i = 0; i < s; i++) {
             QIcon finalIcon;
+            const QImage image = cache.getImage(
+                pictureIdList.value(i), imageList[i], QSize(502, 377));
 
-            // Load image data into a QPixmap and convert it to a QIcon
-            if (pixmap.loadFromData(image, "WEBP") == true) {
-                finalIcon.addPixmap(pixmap);
-            }
-
+            // Convert the scaled image to a QIcon
+            finalIcon.addPixmap(QPixmap::fromImage(image));
             m_imageList.push_back(finalIcon);
         }
     }
@@ -199,6 +203,32 @@ struct InfoData {
     QVector<QIcon> m_imageList;  ///< A list of icons generated from image data.
 };
 
+/**
+ * @struct DatabaseConnection
+ * @brief The tombll.db connection of one thread and its prepared queries.
+ *
+ * A `QSqlDatabase` may only be used from the thread that opened it, so each
+ * thread gets its own connection. It is removed when the thread exits or
+ * when `Data::initializeDatabase` points at another database.
+ */
+struct DatabaseConnection {
+    DatabaseConnection(const QString& name, int generation)
+        : m_name(name), m_generation(generation) {}
+    ~DatabaseConnection();
+
+    QString m_name;        ///< Qt connection name, unique per thread.
+    int m_generation;      ///< The `Data::initializeDatabase` call it is for.
+    QHash<QString, QSqlQuery> m_queries;  ///< Prepared queries by SQL text.
+};
+
+/**
+ * @class Data
+ * @brief Queries on tombll.db, safe to call from any thread.
+ *
+ * Readers run concurrently on their own connections and reuse the
+ * statements prepared on it. The writers, `setDownloadMd5` and
+ * `updateSearchIndex`, run alone.
+ */
 class Data : public QObject {
     Q_OBJECT
 
@@ -209,36 +239,14 @@ class Data : public QObject {
         return instance;
     }
 
-    bool initializeDatabase(const QString& path) {
-        bool status = false;
-        const QString filePath = QString("%1/%2").arg(path, "tombll.db");
-        QFileInfo fileInfo(filePath);
-
-        // Open the file
-        if (!fileInfo.exists() || !fileInfo.isFile()) {
-            qCritical()
-                << "Error: The database path is not a regular file: " << path;
-            status = false;
-        } else {
-            db = QSqlDatabase::addDatabase("QSQLITE");
-            db.setDatabaseName(QString("%1/tombll.db").arg(path));
-            // db.setConnectOptions("QSQLITE_OPEN_READONLY");
-            if (db.open() == true) {  // flawfinder: ignore
-                status = true;
-            } else {
-                qDebug() << "Error opening database:" << db.lastError().text();
-                status = false;
-            }
-        }
-        return status;
-    }
-
-    void releaseDatabase() {
-        db.close();
-    }
+    bool initializeDatabase(const QString& path);
+    void releaseDatabase();
 
     qint64 getListRowCount();
     QVector<ListItemData> getListItems();
+    void getListItems(
+        qint64 batchSize,
+        const std::function<void(const QVector<ListItemData>&)>& batchReady);
     InfoData getInfo(int id);
     QString getWalkthrough(int id);
     int getType(int id);
@@ -247,13 +255,42 @@ class Data : public QObject {
     ZipData getDownload(const int id);
     void setDownloadMd5(const int id, const QString& newMd5sum);
 
+    /**
+     * @brief Bring the full-text index up to date with tombll.db.
+     *
+     * The index is the FTS5 table LevelSearch inside tombll.db. Triggers on
+     * Level, Info, Author and AuthorList note every level whose text is
+     * added, edited or removed, whatever writes it, and only those levels
+     * are indexed again. The whole index is built when it is new.
+     *
+     * @return true if the index is up to date.
+     */
+    bool updateSearchIndex();
+    /**
+     * @brief Search the full-text index, every word also matches as a prefix.
+     * @param[in] text Words typed by the user, all of them must match.
+     * @param[in] field 0 searches title, body and walkthrough, 1 the authors.
+     * @return LevelIDs, best match first.
+     */
+    QVector<qint64> searchLevels(const QString& text, int field);
+    /**
+     * @brief Turn typed words into an FTS5 MATCH expression.
+     * @return Empty when there is nothing to search for.
+     */
+    static QString searchExpression(const QString& text, int field);
+
  private:
     Data() {}
-    ~Data() {
-        db.close();
-    }
+    ~Data() {}
+
+    DatabaseConnection* connection();
+    bool prepareQuery(const QString& sql, QSqlQuery* query);
 
-    QSqlDatabase db;
+    QThreadStorage<DatabaseConnection*> m_connections;
+    QString m_databasePath;
+    QAtomicInt m_generation;
+    // Held for read by every query and for write by setDownloadMd5
+    QReadWriteLock m_lock{QReadWriteLock::Recursive};
     Q_DISABLE_COPY(Data)
 };
 
@@ -0,0 +1,500 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "FileBatch.hpp"
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <QDebug>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+// Largest write in one operation, longer data is written in rounds
+static constexpr quint32 MAX_WRITE = 1U << 30;
+
+FileBatch::FileBatch(quint32 depth, bool useRing)
+        : m_depth(qMax<quint32>(depth, 1)) {
+    if ((useRing == true) && (setUpRing(m_depth) == false)) {
+        qDebug() << "io_uring is not available, using plain system calls";
+    }
+}
+
+FileBatch::~FileBatch() {
+    closeRing();
+}
+
+void FileBatch::closeRing() {
+    if (m_sqes != nullptr) {
+        (void)munmap(m_sqes, m_sqesSize);
+    }
+    if ((m_cqMap != nullptr) && (m_cqMap != m_sqMap)) {
+        (void)munmap(m_cqMap, m_cqMapSize);
+    }
+    if (m_sqMap != nullptr) {
+        (void)munmap(m_sqMap, m_sqMapSize);
+    }
+    if (m_ring >= 0) {
+        (void)::close(m_ring);
+    }
+    m_sqes = nullptr;
+    m_cqMap = nullptr;
+    m_sqMap = nullptr;
+    m_ring = -1;
+}
+
+bool FileBatch::usesRing() const {
+    return m_ring >= 0;
+}
+
+bool FileBatch::setUpRing(quint32 depth) {
+    bool status = false;
+    io_uring_params params;
+    (void)memset(&params, 0, sizeof(params));
+    const int ring = int(syscall(__NR_io_uring_setup, depth, &params));
+
+    if (ring >= 0) {
+        // Every operation used here must be supported
+        std::vector<char> buffer(sizeof(io_uring_probe) +
+            (256 * sizeof(io_uring_probe_op)), 0);
+        io_uring_probe* probe =
+            reinterpret_cast<io_uring_probe*>(buffer.data());
+        status = (syscall(__NR_io_uring_register, ring,
+            IORING_REGISTER_PROBE, probe, 256) == 0);
+        for (const int opcode : {IORING_OP_OPENAT, IORING_OP_WRITE,
+                IORING_OP_FSYNC, IORING_OP_CLOSE, IORING_OP_RENAMEAT,
+                IORING_OP_UNLINKAT}) {
+            status = status && (opcode < probe->ops_len) &&
+                ((probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0);
+        }
+
+        m_sqMapSize = params.sq_off.array +
+            (params.sq_entries * sizeof(quint32));
+        m_cqMapSize = params.cq_off.cqes +
+            (params.cq_entries * sizeof(io_uring_cqe));
+        const bool single = ((params.features & IORING_FEAT_SINGLE_MMAP) != 0);
+        if (single == true) {
+            m_sqMapSize = qMax(m_sqMapSize, m_cqMapSize);
+            m_cqMapSize = m_sqMapSize;
+        }
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+        if (status == true) {
+            m_sqMap = mmap(nullptr, m_sqMapSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+            m_cqMap = (single == true) ? m_sqMap :
+                mmap(nullptr, m_cqMapSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+            m_sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+            if (m_sqMap == MAP_FAILED) {
+                m_sqMap = nullptr;
+            }
+            if (m_cqMap == MAP_FAILED) {
+                m_cqMap = nullptr;
+            }
+            if (m_sqes == MAP_FAILED) {
+                m_sqes = nullptr;
+            }
+            status = (m_sqMap != nullptr) && (m_cqMap != nullptr) &&
+                (m_sqes != nullptr);
+        }
+
+        if (status == true) {
+            char* sq = static_cast<char*>(m_sqMap);
+            char* cq = static_cast<char*>(m_cqMap);
+            m_entries = params.sq_entries;
+            m_sqTail = reinterpret_cast<quint32*>(sq + params.sq_off.tail);
+            m_sqMask = *reinterpret_cast<quint32*>(
+                sq + params.sq_off.ring_mask);
+            m_sqArray = reinterpret_cast<quint32*>(sq + params.sq_off.array);
+            m_cqHead = reinterpret_cast<quint32*>(cq + params.cq_off.head);
+            m_cqTail = reinterpret_cast<quint32*>(cq + params.cq_off.tail);
+            m_cqMask = *reinterpret_cast<quint32*>(
+                cq + params.cq_off.ring_mask);
+            m_cqes = cq + params.cq_off.cqes;
+            m_ring = ring;
+        } else {
+            if (m_sqes != nullptr) {
+                (void)munmap(m_sqes, m_sqesSize);
+            }
+            if ((m_cqMap != nullptr) && (m_cqMap != m_sqMap)) {
+                (void)munmap(m_cqMap, m_cqMapSize);
+            }
+            if (m_sqMap != nullptr) {
+                (void)munmap(m_sqMap, m_sqMapSize);
+            }
+            m_sqes = nullptr;
+            m_cqMap = nullptr;
+            m_sqMap = nullptr;
+            (void)::close(ring);
+        }
+    }
+    return status;
+}
+
+int FileBatch::runPlain(const Operation& operation) {
+    int result = -EINVAL;
+    switch (operation.opcode) {
+        case IORING_OP_OPENAT:
+            result = ::openat(operation.fd, operation.path,
+                int(operation.flags), mode_t(operation.mode));
+            break;
+        case IORING_OP_WRITE:
+            result = int(::pwrite(operation.fd, operation.data,
+                operation.size, off_t(operation.offset)));
+            break;
+        case IORING_OP_FSYNC:
+            result = ::fsync(operation.fd);
+            break;
+        case IORING_OP_CLOSE:
+            result = ::close(operation.fd);
+            break;
+        case IORING_OP_RENAMEAT:
+            result = ::renameat(operation.fd, operation.path,
+                operation.fd, operation.path2);
+            break;
+        case IORING_OP_UNLINKAT:
+            result = ::unlinkat(operation.fd, operation.path,
+                int(operation.flags));
+            break;
+        default:
+            errno = EINVAL;
+            break;
+    }
+    return (result < 0) ? -errno : result;
+}
+
+void FileBatch::runRing(
+        QVector<Operation>* operations, QVector<int>* results) {
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(m_sqes);
+    io_uring_cqe* cqes = static_cast<io_uring_cqe*>(m_cqes);
+    qint64 next = 0;
+    int error = 0;
+
+    while ((next < operations->size()) && (error == 0)) {
+        const quint32 count = quint32(qMin<qint64>(
+            m_entries, operations->size() - next));
+        quint32 tail = *m_sqTail;
+        for (quint32 i = 0; i < count; i++) {
+            const Operation& operation = (*operations)[next + i];
+            const quint32 index = tail & m_sqMask;
+            io_uring_sqe* sqe = &sqes[index];
+            (void)memset(sqe, 0, sizeof(io_uring_sqe));
+            sqe->opcode = operation.opcode;
+            sqe->fd = operation.fd;
+            sqe->user_data = quint64(next + i);
+            switch (operation.opcode) {
+                case IORING_OP_OPENAT:
+                    sqe->addr = quint64(uintptr_t(operation.path));
+                    sqe->len = operation.mode;
+                    sqe->open_flags = operation.flags;
+                    break;
+                case IORING_OP_WRITE:
+                    sqe->addr = quint64(uintptr_t(operation.data));
+                    sqe->len = operation.size;
+                    sqe->off = operation.offset;
+                    break;
+                case IORING_OP_RENAMEAT:
+                    sqe->addr = quint64(uintptr_t(operation.path));
+                    sqe->len = quint32(operation.fd);
+                    sqe->addr2 = quint64(uintptr_t(operation.path2));
+                    break;
+                case IORING_OP_UNLINKAT:
+                    sqe->addr = quint64(uintptr_t(operation.path));
+                    sqe->unlink_flags = operation.flags;
+                    break;
+                default:
+                    break;
+            }
+            m_sqArray[index] = index;
+            tail++;
+        }
+        __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+
+        // Submit the whole chunk and wait until all of it is done. After
+        // a failure the operations the kernel took are still waited for,
+        // they use buffers the caller frees when this returns.
+        quint32 toSubmit = count;
+        quint32 completed = 0;
+        while (completed < ((error == 0) ? count : count - toSubmit)) {
+            const long submitted = syscall(__NR_io_uring_enter, m_ring,
+                (error == 0) ? toSubmit : 0, 1, IORING_ENTER_GETEVENTS,
+                nullptr, 0);
+            if (submitted >= 0) {
+                toSubmit -= quint32(submitted);
+            } else if ((errno == EINTR) || (errno == EAGAIN)) {
+                // Tried again
+            } else if (error == 0) {
+                error = errno;
+            } else {
+                // Waiting fails too, poll the completion queue
+                (void)sched_yield();
+            }
+
+            quint32 head = *m_cqHead;
+            const quint32 ready = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+            while (head != ready) {
+                const io_uring_cqe& cqe = cqes[head & m_cqMask];
+                if (cqe.user_data < quint64(results->size())) {
+                    (*results)[qint64(cqe.user_data)] = cqe.res;
+                }
+                head++;
+                completed++;
+            }
+            __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+        }
+        next += count;
+    }
+
+    if (error != 0) {
+        // Entries left in the queue must never be submitted, the rest of
+        // the batch and later ones use plain system calls
+        qWarning() << "io_uring failed, using plain system calls:"
+            << strerror(error);
+        closeRing();
+        for (qint64 i = 0; i < operations->size(); i++) {
+            if ((*results)[i] == INT_MIN) {
+                (*results)[i] = runPlain((*operations)[i]);
+            }
+        }
+    }
+}
+
+void FileBatch::run(QVector<Operation>* operations, QVector<int>* results) {
+    results->fill(INT_MIN, operations->size());
+    if (m_ring >= 0) {
+        runRing(operations, results);
+    } else {
+        for (qint64 i = 0; i < operations->size(); i++) {
+            (*results)[i] = runPlain((*operations)[i]);
+        }
+    }
+}
+
+bool FileBatch::check(const QVector<int>& results, const QStringList& paths,
+        const char* what) const {
+    qint64 failed = 0;
+    for (qint64 i = 0; i < results.size(); i++) {
+        if (results[i] < 0) {
+            if (failed == 0) {
+                qWarning() << "Failed to" << what << paths[i] << ":"
+                    << strerror(-results[i]);
+            }
+            failed++;
+        }
+    }
+    if (failed > 1) {
+        qWarning() << "Failed to" << what << failed << "files in all";
+    }
+    return failed == 0;
+}
+
+bool FileBatch::writeFiles(const QVector<BatchFile>& files, Sync sync) {
+    bool status = true;
+    // Every file in a group is open until the group is written, keep that
+    // below the limit on open files
+    for (qint64 first = 0; first < files.size(); first += m_depth) {
+        const bool last = (first + qint64(m_depth) >= files.size());
+        // One syncfs after the last group covers the earlier ones
+        const Sync groupSync = ((sync == Sync::End) && (last == false)) ?
+            Sync::None : sync;
+        status = writeGroup(files.mid(first, m_depth), groupSync) && status;
+    }
+    return status;
+}
+
+bool FileBatch::writeGroup(const QVector<BatchFile>& files, Sync sync) {
+    QVector<QByteArray> names;
+    QStringList paths;
+    QVector<Operation> operations;
+    QVector<int> results;
+    names.reserve(files.size());
+    for (const BatchFile& file : files) {
+        names.append(QFile::encodeName(file.path));
+        paths.append(file.path);
+    }
+
+    for (const QByteArray& name : qAsConst(names)) {
+        operations.append({IORING_OP_OPENAT, AT_FDCWD, name.constData(),
+            nullptr, nullptr, 0, 0,
+            quint32(O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC), 0666});
+    }
+    run(&operations, &results);
+    bool status = check(results, paths, "create");
+    const QVector<int> fds = results;
+
+    // Short writes are continued in the next round
+    QVector<quint64> written(files.size(), 0);
+    QVector<int> errors(files.size(), 0);
+    QVector<qint64> pending;
+    for (qint64 i = 0; i < files.size(); i++) {
+        if ((fds[i] >= 0) && (files[i].data.isEmpty() == false)) {
+            pending.append(i);
+        }
+    }
+    while (pending.isEmpty() == false) {
+        operations.clear();
+        for (const qint64 i : qAsConst(pending)) {
+            const QByteArray& data = files[i].data;
+            operations.append({IORING_OP_WRITE, fds[i], nullptr, nullptr,
+                data.constData() + written[i],
+                quint32(qMin<quint64>(MAX_WRITE, data.size() - written[i])),
+                written[i], 0, 0});
+        }
+        run(&operations, &results);
+
+        QVector<qint64> again;
+        for (qint64 j = 0; j < pending.size(); j++) {
+            const qint64 i = pending[j];
+            if (results[j] > 0) {
+                written[i] += quint64(results[j]);
+                if (written[i] < quint64(files[i].data.size())) {
+                    again.append(i);
+                }
+            } else {
+                errors[i] = (results[j] < 0) ? results[j] : -EIO;
+            }
+        }
+        pending = again;
+    }
+
+    operations.clear();
+    QStringList opened;
+    if (sync == Sync::Files) {
+        for (qint64 i = 0; i < files.size(); i++) {
+            if ((fds[i] >= 0) && (errors[i] == 0)) {
+                operations.append({IORING_OP_FSYNC, fds[i], nullptr, nullptr,
+                    nullptr, 0, 0, 0, 0});
+                opened.append(paths[i]);
+            }
+        }
+        run(&operations, &results);
+        status = check(results, opened, "sync") && status;
+    } else if (sync == Sync::End) {
+        const int fd = fds.isEmpty() ? -1 :
+            *std::max_element(fds.cbegin(), fds.cend());
+        if ((fd >= 0) && (::syncfs(fd) != 0)) {
+            qWarning() << "Failed to sync the file system";
+            status = false;
+        }
+    }
+
+    operations.clear();
+    opened.clear();
+    for (qint64 i = 0; i < files.size(); i++) {
+        if (fds[i] >= 0) {
+            operations.append({IORING_OP_CLOSE, fds[i], nullptr, nullptr,
+                nullptr, 0, 0, 0, 0});
+            opened.append(paths[i]);
+        }
+    }
+    run(&operations, &results);
+    status = check(results, opened, "close") && status;
+    status = check(errors, paths, "write") && status;
+    return status;
+}
+
+bool FileBatch::renameFiles(const QVector<QPair<QString, QString>>& moves) {
+    QVector<QByteArray> names;
+    QStringList paths;
+    QVector<Operation> operations;
+    QVector<int> results;
+    names.reserve(moves.size() * 2);
+    for (const auto& move : moves) {
+        names.append(QFile::encodeName(move.first));
+        names.append(QFile::encodeName(move.second));
+        paths.append(move.first);
+    }
+    for (qint64 i = 0; i < moves.size(); i++) {
+        operations.append({IORING_OP_RENAMEAT, AT_FDCWD,
+            names[2 * i].constData(), names[(2 * i) + 1].constData(),
+            nullptr, 0, 0, 0, 0});
+    }
+    run(&operations, &results);
+    return check(results, paths, "rename");
+}
+
+QVector<int> FileBatch::unlinkAll(const QStringList& paths, quint32 flags) {
+    QVector<QByteArray> names;
+    QVector<Operation> operations;
+    QVector<int> results;
+    names.reserve(paths.size());
+    for (const QString& path : paths) {
+        names.append(QFile::encodeName(path));
+    }
+    for (const QByteArray& name : qAsConst(names)) {
+        operations.append({IORING_OP_UNLINKAT, AT_FDCWD, name.constData(),
+            nullptr, nullptr, 0, 0, flags, 0});
+    }
+    run(&operations, &results);
+    return results;
+}
+
+bool FileBatch::removeFiles(const QStringList& paths) {
+    QVector<int> results = unlinkAll(paths, 0);
+
+    // Empty directories are told apart by the error and removed again
+    QStringList directories;
+    for (qint64 i = 0; i < results.size(); i++) {
+        if (results[i] == -EISDIR) {
+            directories.append(paths[i]);
+            results[i] = 0;
+        }
+    }
+    return check(results, paths, "remove") &&
+        check(unlinkAll(directories, AT_REMOVEDIR), directories, "remove");
+}
+
+bool FileBatch::removeTree(const QString& path) {
+    bool status = true;
+    const QFileInfo root(path);
+    if ((root.isDir() == true) && (root.isSymLink() == false)) {
+        QStringList files;
+        QMap<int, QStringList> directories;  // By depth
+        const int rootDepth = path.count('/');
+        QDirIterator it(path,
+            QDir::AllEntries | QDir::Hidden | QDir::System |
+                QDir::NoDotAndDotDot,
+            QDirIterator::Subdirectories);
+        while (it.hasNext() == true) {
+            const QString entry = it.next();
+            const QFileInfo info = it.fileInfo();
+            if ((info.isDir() == true) && (info.isSymLink() == false)) {
+                directories[entry.count('/') - rootDepth].append(entry);
+            } else {
+                files.append(entry);
+            }
+        }
+        directories[0].append(path);
+
+        status = check(unlinkAll(files, 0), files, "remove");
+        for (auto depth = directories.end(); depth != directories.begin();) {
+            --depth;
+            status = status && check(unlinkAll(depth.value(), AT_REMOVEDIR),
+                depth.value(), "remove");
+        }
+    } else if (root.exists() || root.isSymLink()) {
+        status = removeFiles({path});
+    }
+    return status;
+}
@@ -0,0 +1,122 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SRC_FILEBATCH_HPP_
+#define SRC_FILEBATCH_HPP_
+
+#include <QByteArray>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+struct BatchFile {
+    QString path;
+    QByteArray data;
+};
+
+/**
+ * @class FileBatch
+ * @brief Create, rename and remove many files with few system calls.
+ *
+ * Operations are queued on an io_uring and submitted together, one
+ * io_uring_enter for up to a queue of them. When the kernel has no
+ * io_uring, it is turned off, or an operation is not supported the same
+ * operations are done with plain system calls one at a time.
+ *
+ * Not thread safe, every thread needs its own batch.
+ */
+class FileBatch {
+ public:
+    enum class Sync {
+        None,       // Leave it to the kernel
+        Files,      // fsync every file before closing it
+        End         // One syncfs when the batch is written
+    };
+
+    /**
+     * @param[in] depth Operations in flight at once.
+     * @param[in] useRing false always uses plain system calls.
+     */
+    explicit FileBatch(quint32 depth = 256, bool useRing = true);
+    ~FileBatch();
+
+    /**
+     * @brief If operations go through an io_uring.
+     */
+    bool usesRing() const;
+    /**
+     * @brief Create or truncate files and write their data.
+     *
+     * The files are opened, written and closed in groups of the depth, so
+     * only that many are open at once. The directories must exist.
+     */
+    bool writeFiles(const QVector<BatchFile>& files, Sync sync);
+    /**
+     * @brief Rename files, the first path of each pair to the second.
+     */
+    bool renameFiles(const QVector<QPair<QString, QString>>& moves);
+    /**
+     * @brief Remove files, symbolic links or empty directories.
+     */
+    bool removeFiles(const QStringList& paths);
+    /**
+     * @brief Remove a file or a directory with everything in it.
+     *
+     * Files are removed in one batch and then the directories, deepest
+     * first. Symbolic links are removed, not followed.
+     */
+    bool removeTree(const QString& path);
+
+ private:
+    struct Operation {
+        quint8 opcode;
+        int fd;
+        const char* path;
+        const char* path2;
+        const char* data;
+        quint32 size;
+        quint64 offset;
+        quint32 flags;
+        quint32 mode;
+    };
+
+    bool setUpRing(quint32 depth);
+    void closeRing();
+    bool writeGroup(const QVector<BatchFile>& files, Sync sync);
+    void run(QVector<Operation>* operations, QVector<int>* results);
+    void runRing(QVector<Operation>* operations, QVector<int>* results);
+    static int runPlain(const Operation& operation);
+    QVector<int> unlinkAll(const QStringList& paths, quint32 flags);
+    bool check(const QVector<int>& results, const QStringList& paths,
+        const char* what) const;
+
+    quint32 m_depth = 1;
+    int m_ring = -1;
+    quint32 m_entries = 0;
+    void* m_sqMap = nullptr;
+    size_t m_sqMapSize = 0;
+    void* m_cqMap = nullptr;
+    size_t m_cqMapSize = 0;
+    void* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+    quint32* m_sqTail = nullptr;
+    quint32 m_sqMask = 0;
+    quint32* m_sqArray = nullptr;
+    quint32* m_cqHead = nullptr;
+    quint32* m_cqTail = nullptr;
+    quint32 m_cqMask = 0;
+    void* m_cqes = nullptr;
+};
+
+#endif  // SRC_FILEBATCH_HPP_
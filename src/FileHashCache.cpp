@@ -0,0 +1,132 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "FileHashCache.hpp"
+#include <sys/stat.h>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QVector>
+#include <cstring>
+
+static constexpr quint32 FILEHASH_VERSION = 1;
+
+bool FileHashCache::setUpCamp(const QString& levelDir) {
+    QMutexLocker locker(&m_mutex);
+    m_path = QString("%1%2%3").arg(levelDir, QDir::separator(), ".hashes");
+    m_records.clear();
+    m_changed = false;
+
+    QFile file(m_path);
+    if ((file.open(QIODevice::ReadOnly) == true) &&  // flawfinder: ignore
+            (file.size() >= qint64(sizeof(FileHashHeader)))) {
+        const QByteArray data = file.readAll();
+        FileHashHeader header;
+        (void)memcpy(&header, data.constData(), sizeof(FileHashHeader));
+
+        if ((strncmp(header.magic.data(), "TRLH", 4) == 0) &&
+                (header.version == FILEHASH_VERSION) &&
+                (data.size() == qint64(sizeof(FileHashHeader)) +
+                    (qint64(header.count) * sizeof(FileHashRecord)))) {
+            const char* records = data.constData() + sizeof(FileHashHeader);
+            for (quint32 i = 0; i < header.count; i++) {
+                FileHashRecord record;
+                (void)memcpy(&record,
+                    records + (qint64(i) * sizeof(FileHashRecord)),
+                    sizeof(FileHashRecord));
+                m_records.insert({record.device, record.inode}, record);
+            }
+        } else {
+            qWarning() << "Ignoring invalid hash cache:" << m_path;
+        }
+    }
+    // A missing table is not an error, it is written on the first save
+    return true;
+}
+
+bool FileHashCache::stat(const QString& path, FileHashRecord* record) {
+    struct stat info;
+    bool status = false;
+    if ((::stat(QFile::encodeName(path).constData(), &info) == 0) &&
+            (S_ISREG(info.st_mode) == true)) {
+        (void)memset(record, 0, sizeof(FileHashRecord));
+        record->device = info.st_dev;
+        record->inode = info.st_ino;
+        record->size = info.st_size;
+        record->modified = (qint64(info.st_mtim.tv_sec) * 1000000000) +
+            info.st_mtim.tv_nsec;
+        status = true;
+    }
+    return status;
+}
+
+QString FileHashCache::find(const QString& path) {
+    QString result;
+    FileHashRecord now;
+    if (stat(path, &now) == true) {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_records.constFind({now.device, now.inode});
+        if ((it != m_records.constEnd()) &&
+                (it->size == now.size) &&
+                (it->modified == now.modified)) {
+            result = QString(QByteArray(it->md5.data(), 16).toHex());
+        }
+    }
+    return result;
+}
+
+void FileHashCache::insert(const QString& path, const QString& md5sum) {
+    FileHashRecord record;
+    const QByteArray md5 = QByteArray::fromHex(md5sum.toLatin1());
+    if ((md5.size() == 16) && (stat(path, &record) == true)) {
+        (void)memcpy(record.md5.data(), md5.constData(), 16);
+        QMutexLocker locker(&m_mutex);
+        m_records.insert({record.device, record.inode}, record);
+        m_changed = true;
+    }
+}
+
+bool FileHashCache::save() {
+    QMutexLocker locker(&m_mutex);
+    bool status = true;
+    if ((m_changed == true) && (m_path.isEmpty() == false)) {
+        QVector<FileHashRecord> records;
+        records.reserve(m_records.size());
+        for (const FileHashRecord& record : qAsConst(m_records)) {
+            records.append(record);
+        }
+
+        FileHashHeader header;
+        (void)memcpy(header.magic.data(), "TRLH", 4);
+        header.version = FILEHASH_VERSION;
+        header.count = records.size();
+
+        const qint64 recordsSize =
+            qint64(records.size()) * sizeof(FileHashRecord);
+        QSaveFile file(m_path);
+        status = (file.open(  // flawfinder: ignore
+                QIODevice::WriteOnly) == true) &&
+            (file.write(reinterpret_cast<const char*>(&header),
+                sizeof(FileHashHeader)) == qint64(sizeof(FileHashHeader))) &&
+            (file.write(reinterpret_cast<const char*>(records.constData()),
+                recordsSize) == recordsSize) &&
+            file.commit();
+        if (status == true) {
+            m_changed = false;
+        } else {
+            qWarning() << "Failed to write hash cache:" << m_path;
+        }
+    }
+    return status;
+}
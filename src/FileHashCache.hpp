@@ -0,0 +1,94 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SRC_FILEHASHCACHE_HPP_
+#define SRC_FILEHASHCACHE_HPP_
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <array>
+
+#pragma pack(push, 1)  // Set 1-byte alignment
+struct FileHashHeader {
+    std::array<char, 4> magic;          // Magic number ("TRLH")
+    quint32 version;                    // Bumped when the layout changes
+    quint32 count;                      // Number of records
+};
+
+struct FileHashRecord {
+    quint64 device;                     // st_dev
+    quint64 inode;                      // st_ino
+    qint64 size;                        // st_size
+    qint64 modified;                    // st_mtim in ns
+    std::array<char, 16> md5;
+};
+#pragma pack(pop)
+
+/**
+ * @class FileHashCache
+ * @brief MD5 sums of files that have been hashed before.
+ *
+ * Entries are keyed by device and inode and only trusted while the size
+ * and the modification time in nanoseconds are the same, so a lookup
+ * never reads the file itself. The table lives in `.hashes` under the
+ * level directory and is written by save(). Safe to use from any thread.
+ */
+class FileHashCache {
+ public:
+    static FileHashCache& getInstance() {
+        // cppcheck-suppress threadsafety-threadsafety
+        static FileHashCache instance;
+        return instance;
+    }
+
+    bool setUpCamp(const QString& levelDir);
+    /**
+     * @brief The hex MD5 of a file if it has not changed since it was hashed.
+     * @return The sum, or an empty string when it has to be calculated.
+     */
+    QString find(const QString& path);
+    /**
+     * @brief Remember the hex MD5 of a file as it is now.
+     */
+    void insert(const QString& path, const QString& md5sum);
+    /**
+     * @brief Write the table if something was added since the last save.
+     */
+    bool save();
+
+ private:
+    struct Key {
+        quint64 device;
+        quint64 inode;
+        bool operator==(const Key& other) const {
+            return (device == other.device) && (inode == other.inode);
+        }
+    };
+    friend uint qHash(const Key& key, uint seed) {
+        return qHash(key.device, seed) ^ qHash(key.inode, seed);
+    }
+
+    static bool stat(const QString& path, FileHashRecord* record);
+
+    FileHashCache() {}
+
+    QMutex m_mutex;
+    QHash<Key, FileHashRecord> m_records;
+    QString m_path;
+    bool m_changed = false;
+    Q_DISABLE_COPY(FileHashCache)
+};
+
+#endif  // SRC_FILEHASHCACHE_HPP_
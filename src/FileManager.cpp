@@ -12,99 +12,57 @@
  */
 
 #include "FileManager.hpp"
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <QFile>
 #include <QIODevice>
 #include <QDir>
 #include <QDebug>
 #include <QDirIterator>
+#include <QRandomGenerator>
 #include <QtCore>
 #include <QByteArray>
 #include <QDataStream>
+#include <QSettings>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "FileBatch.hpp"
+#include "FileHashCache.hpp"
 #include "GameFileTree.hpp"
+#include "Md5Lanes.hpp"
+#include "ObjectStore.hpp"
 #include "miniz.h"
 #include "miniz_zip.h"
 
-struct StaticTrees {
-    QList<GameFileTree*> data;
-    StaticTrees() {
-        data.append(new GameFileTree(QStringList{
-            "TOMBRAID/tomb.exe",
-            "dosbox.exe",
-        }));
-        data.append(new GameFileTree(QStringList{
-            "Tomb1Main.exe",
-            "cfg",
-            "data",
-            "shaders",
-        }));
-        data.append(new GameFileTree(QStringList{
-            "TR1X.exe",
-            "cfg",
-            "data",
-            "shaders",
-        }));
-        data.append(new GameFileTree(QStringList{
-            "TR2Main.json",
-            "data",
-        }));
-        data.append(new GameFileTree(QStringList{
-            "Tomb2.exe",
-            "data",
-        }));
-        data.append(new GameFileTree(QStringList{
-            "tomb3_ConfigTool.json",
-            "tomb3.exe",
-            "audio",
-            "data",
-            "pix",
-        }));
-        data.append(new GameFileTree(QStringList{
-            "tomb3.exe",
-            "audio",
-            "data",
-            "Pix",
-        }));
-        data.append(new GameFileTree(QStringList{
-            "tomb3.exe",
-            "audio",
-            "Data",
-        }));
-        data.append(new GameFileTree(QStringList{
-            "tomb3.exe",
-            "audio",
-            "data",
-            "pix",
-        }));
-        data.append(new GameFileTree(QStringList{
-            "tomb4.exe",
-            "audio",
-            "Data",
-        }));
-        data.append(new GameFileTree(QStringList{
-            "tomb4.exe",
-            "audio",
-            "data",
-            "pix",
-        }));
-        data.append(new GameFileTree(QStringList{
-            "audio",
-            "data",
-            "pix",
-        }));
-        data.append(new GameFileTree(QStringList{
-            "PCTomb5.exe",
-            "audio",
-            "data",
-            "pix",
-        }));
-    }
-    ~StaticTrees() {
-        for (GameFileTree* tree : data) {
-            delete tree;
-        }
-        data.clear();
-    }
-};
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+// Layouts of the games and the TRLE engines, earlier ones win
+static constexpr std::array<GamePattern, 13> GAME_PATTERNS = {{
+    {{"TOMBRAID/tomb.exe", "dosbox.exe"}},
+    {{"Tomb1Main.exe", "cfg", "data", "shaders"}},
+    {{"TR1X.exe", "cfg", "data", "shaders"}},
+    {{"TR2Main.json", "data"}},
+    {{"Tomb2.exe", "data"}},
+    {{"tomb3_ConfigTool.json", "tomb3.exe", "audio", "data", "pix"}},
+    {{"tomb3.exe", "audio", "data", "Pix"}},
+    {{"tomb3.exe", "audio", "Data"}},
+    {{"tomb3.exe", "audio", "data", "pix"}},
+    {{"tomb4.exe", "audio", "Data"}},
+    {{"tomb4.exe", "audio", "data", "pix"}},
+    {{"audio", "data", "pix"}},
+    {{"PCTomb5.exe", "audio", "data", "pix"}},
+}};
+static constexpr auto GAME_PATTERN_SET = compileGamePatterns(GAME_PATTERNS);
+static_assert(GAME_PATTERN_SET.overflow == false,
+    "More distinct game pattern paths than bits in a mask");
 
 
 bool FileManager::setUpCamp(const QString& levelDir, const QString& gameDir) {
@@ -145,9 +103,12 @@ const QString FileManager::calculateMD5(
         const QString& fileName, bool lookGameDir) {
     const QString path = FileManager::lookGameDir(fileName, lookGameDir);
     QFileInfo fileInfo(path);
-    QString result;
+    FileHashCache& hashCache = FileHashCache::getInstance();
+    QString result = hashCache.find(path);
 
-    if (fileInfo.exists() && !fileInfo.isFile()) {
+    if (result.isEmpty() == false) {
+        // Cache hit, too frequent to log one by one
+    } else if (fileInfo.exists() && !fileInfo.isFile()) {
         qDebug() << "Error: The path is not a regular file." << path;
     } else {
         QFile file(path);
@@ -163,94 +124,274 @@ const QString FileManager::calculateMD5(
                 result = QString(md5.result().toHex());
             }
             file.close();
+            hashCache.insert(path, result);
         }
     }
     return result;
 }
 
+// Entries this small are written in batches of SMALL_BATCH files
+static constexpr quint64 SMALL_ENTRY = 64 * 1024;
+static constexpr int SMALL_BATCH = 64;
+
+// Size and CRC-32 of a file on disk compared with a zip entry
+static bool sameAsEntry(const QString& path, quint64 size, quint32 crc) {
+    bool status = false;
+    QFile file(path);
+    if ((file.open(QIODevice::ReadOnly) == true) &&  // flawfinder: ignore
+            (file.size() == qint64(size))) {
+        if (size == 0) {
+            status = (crc == 0);
+        } else {
+            const uchar* data = file.map(0, file.size());
+            status = (data != nullptr) &&
+                (mz_crc32(MZ_CRC32_INIT, data, size_t(size)) == crc);
+        }
+    }
+    return status;
+}
+
+static size_t compareWithObject(
+        void* opaque, mz_uint64 offset, const void* data, size_t size) {
+    Q_UNUSED(offset);
+    ObjectStore::Match* match = static_cast<ObjectStore::Match*>(opaque);
+    // A short count stops the inflate at the first difference
+    return (match->compare(static_cast<const uchar*>(data),
+        qint64(size)) == true) ? size : 0;
+}
+
+static bool sameAsObject(mz_zip_archive* reader, mz_uint index,
+        const QString& path, quint64 size, quint32 crc) {
+    // Inflated and compared with the object, nothing is written
+    ObjectStore::Match match(path, size, crc);
+    return (match.found() == true) &&
+        ((size == 0) || (mz_zip_reader_extract_to_callback(
+            reader, index, compareWithObject, &match, 0) == true)) &&
+        (match.place() == true);
+}
+
 bool FileManager::extractZip(
     const QString& zipFilename,
-    const QString& outputFolder) {
+    const QString& outputFolder,
+    bool incremental,
+    bool prune) {
     bool status = false;
     const QString& zipPath =
         QString("%1%2%3").arg(m_levelDir.absolutePath(), m_sep, zipFilename);
     const QString& outputPath =
         QString("%1%2%3").arg(m_levelDir.absolutePath(), m_sep, outputFolder);
+    const QByteArray zipName = QFile::encodeName(zipPath);
 
     qDebug() << "Unzipping file" << zipFilename << "to" << outputPath;
 
-    // Create output folder if it doesn't exist
-    QDir dir(outputPath);
-    if (!dir.exists()) {
-        dir.mkpath(".");
-    }
+    struct Entry {
+        quint32 index;
+        quint64 compressedSize;
+        quint64 size;
+        quint32 crc;
+        QString outFile;
+    };
+    QVector<Entry> entries;
+    QSet<QString> directories;
+    quint64 totalSize = 0;
+    const quint64 gotoPercent = 50;  // Percentage of total work
+    QAtomicInt emitted(0);
+    const QString root = QDir::cleanPath(outputPath);
 
-    // Open the zip file
+    // Read the central directory once for the file list and the directories
     mz_zip_archive zip;
     (void)memset(&zip, 0, sizeof(zip));
-    if (mz_zip_reader_init_file(
-        &zip, zipPath.toUtf8().constData(), 0) == true) {
-        // Extract each file in the zip archive
-        quint64 numFiles = mz_zip_reader_get_num_files(&zip);
+    if (mz_zip_reader_init_file(&zip, zipName.constData(), 0) == true) {
+        const quint32 numFiles = mz_zip_reader_get_num_files(&zip);
         qDebug() << "Zip file contains" << numFiles << "files";
+        status = true;
+        directories.insert(root);
 
-        quint64 gotoPercent = 50;  // Percentage of total work
-        quint64 lastPrintedPercent = 0;  // Last printed percentage
-
-        for (quint64 i = 0; i < numFiles; i++) {
+        for (quint32 i = 0; (i < numFiles) && (status == true); i++) {
             mz_zip_archive_file_stat file_stat;
             if (!mz_zip_reader_file_stat(&zip, i, &file_stat)) {
                 qWarning() << "Failed to get file info for file" << i
                 << "in zip file" << zipPath;
-                mz_zip_reader_end(&zip);
+                status = false;
                 break;
             }
 
-            QString filename = QString::fromUtf8(file_stat.m_filename);
-            if (filename.endsWith('/') == true) {
-                continue;  // Skip directories
+            const QString filename = QString::fromUtf8(file_stat.m_filename);
+            const QString outFile = QDir::cleanPath(
+                QString("%1/%2").arg(root, filename));
+            if (outFile.startsWith(root + "/") == false) {
+                qWarning() << "Zip entry outside of the level directory:"
+                    << filename;
+                status = false;
+            } else if (mz_zip_reader_is_file_a_directory(&zip, i) == true) {
+                directories.insert(outFile);
+            } else {
+                directories.insert(QFileInfo(outFile).path());
+                entries.append({i, file_stat.m_comp_size,
+                    file_stat.m_uncomp_size, file_stat.m_crc32, outFile});
+                totalSize += file_stat.m_comp_size;
             }
+        }
+        mz_zip_reader_end(&zip);
+    } else {
+        qWarning() << "Failed to open zip file" << zipPath;
+    }
 
-            QString outFile = QString("%1/%2").arg(outputPath, filename);
-            qDebug() << "Extracting" << filename;
+    for (const QString& directory : qAsConst(directories)) {
+        if ((status == true) && (QDir().mkpath(directory) == false)) {
+            qWarning() << "Failed to create directory" << directory;
+            status = false;
+        }
+    }
 
-            if (!QDir().mkpath(QFileInfo(outFile).path())) {
-                qWarning() << "Failed to create directory for file" << outFile;
-                mz_zip_reader_end(&zip);
-                break;
-            }
+    if ((status == true) && (entries.isEmpty() == false)) {
+        // Biggest entries first so no worker is left with a big one last
+        std::stable_sort(entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) {
+                return a.compressedSize > b.compressedSize;
+            });
 
-            if (!mz_zip_reader_extract_to_file(
-                    &zip,
-                    i,
-                    outFile.toUtf8().constData(),
-                    0)) {
-                qWarning() << "Failed to extract file" << filename
-                        << "from zip file" << zipPath;
-                mz_zip_reader_end(&zip);
-                break;
-            }
+        QAtomicInt next(0);
+        QAtomicInt failed(0);
+        QAtomicInteger<quint64> done(0);
 
-            quint64 currentPercent =
-                ((i + quint64(1)) * gotoPercent) / numFiles;
+        // Each worker has its own reader on the archive and takes the
+        // next entry when it is done with one
+        QAtomicInt skipped(0);
+        QAtomicInt shared(0);
+        ObjectStore& store = ObjectStore::getInstance();
+        auto worker = [this, &entries, &next, &failed, &done, &emitted,
+                &skipped, &shared, &store, &zipName, &zipPath, gotoPercent,
+                totalSize, incremental]() {
+            mz_zip_archive reader;
+            (void)memset(&reader, 0, sizeof(reader));
+            if (mz_zip_reader_init_file(
+                    &reader, zipName.constData(), 0) == false) {
+                qWarning() << "Failed to open zip file" << zipPath;
+                (void)failed.storeRelease(1);
+            }
 
-            if (currentPercent != lastPrintedPercent) {
-                for (quint64 j = lastPrintedPercent + quint64(1);
-                                j <= currentPercent; j++) {
-                    emit this->fileWorkTickSignal();
-                    QCoreApplication::processEvents();
+            // Small files are unpacked to memory and written together
+            FileBatch batch(SMALL_BATCH * 2);
+            QVector<BatchFile> small;
+            QVector<quint32> smallCrc;
+            auto flush = [&batch, &small, &smallCrc, &failed, &store]() {
+                if (small.isEmpty() == false) {
+                    if (batch.writeFiles(
+                            small, FileBatch::Sync::None) == false) {
+                        (void)failed.storeRelease(1);
+                    }
+                    for (qint64 j = 0; j < small.size(); j++) {
+                        store.add(small[j].path, smallCrc[j]);
+                    }
+                    small.clear();
+                    smallCrc.clear();
+                }
+            };
+            while (failed.loadAcquire() == 0) {
+                const int i = next.fetchAndAddOrdered(1);
+                if (i >= entries.size()) {
+                    break;
                 }
-                lastPrintedPercent = currentPercent;
-                if (currentPercent == gotoPercent) {
-                    status = true;
+                const Entry& entry = entries[i];
+                if ((incremental == true) && (sameAsEntry(
+                        entry.outFile, entry.size, entry.crc) == true)) {
+                    (void)skipped.fetchAndAddRelaxed(1);
+                } else if (sameAsObject(&reader, entry.index,
+                        entry.outFile, entry.size, entry.crc) == true) {
+                    (void)shared.fetchAndAddRelaxed(1);
+                } else {
+                    // Never write through a link to a shared object
+                    if (ObjectStore::accepts(entry.outFile) == true) {
+                        (void)QFile::remove(entry.outFile);
+                    }
+                    if (entry.size <= SMALL_ENTRY) {
+                        QByteArray data(int(entry.size), '\0');
+                        if (!mz_zip_reader_extract_to_mem(&reader,
+                                entry.index, data.data(), entry.size, 0)) {
+                            qWarning() << "Failed to extract file"
+                                << entry.outFile << "from zip file"
+                                << zipPath;
+                            (void)failed.storeRelease(1);
+                            break;
+                        }
+                        small.append({entry.outFile, data});
+                        smallCrc.append(entry.crc);
+                        if (small.size() >= SMALL_BATCH) {
+                            flush();
+                        }
+                    } else if (!mz_zip_reader_extract_to_file(&reader,
+                            entry.index, QFile::encodeName(entry.outFile)
+                                .constData(), 0)) {
+                        qWarning() << "Failed to extract file"
+                            << entry.outFile << "from zip file" << zipPath;
+                        (void)failed.storeRelease(1);
+                        break;
+                    } else {
+                        store.add(entry.outFile, entry.crc);
+                    }
                 }
+
+                const quint64 now =
+                    done.fetchAndAddOrdered(entry.compressedSize) +
+                    entry.compressedSize;
+                const int target = (totalSize > 0) ?
+                    int((now * gotoPercent) / totalSize) : 0;
+                int current = emitted.loadAcquire();
+                while (current < target) {
+                    if (emitted.testAndSetOrdered(
+                            current, current + 1) == true) {
+                        emit this->fileWorkTickSignal();
+                    }
+                    current = emitted.loadAcquire();
+                }
+            }
+            if (failed.loadAcquire() == 0) {
+                flush();
             }
+            mz_zip_reader_end(&reader);
+        };
+
+        QThreadPool pool;
+        const int workers = qMin(
+            QThread::idealThreadCount(), int(entries.size()));
+        for (int i = 0; i < workers; i++) {
+            pool.start(QRunnable::create(worker));
         }
-    } else {
-        qWarning() << "Failed to open zip file" << zipPath;
+        pool.waitForDone();
+        status = (failed.loadAcquire() == 0);
+        if (incremental == true) {
+            qDebug() << skipped.loadAcquire() << "of" << entries.size()
+                << "files were already up to date";
+        }
+        if (shared.loadAcquire() > 0) {
+            qDebug() << shared.loadAcquire() << "of" << entries.size()
+                << "files were linked from the object store";
+        }
+    }
+
+    if ((status == true) && (prune == true)) {
+        QSet<QString> inArchive;
+        for (const Entry& entry : qAsConst(entries)) {
+            inArchive.insert(entry.outFile);
+        }
+        QDirIterator it(root, QDir::Files | QDir::Hidden | QDir::System,
+            QDirIterator::Subdirectories);
+        while (it.hasNext() == true) {
+            const QString path = it.next();
+            if ((inArchive.contains(path) == false) &&
+                    (QFile::remove(path) == true)) {
+                qDebug() << "Removed file not in the archive:" << path;
+            }
+        }
+    }
+
+    // Entries without data do not move the progress bar
+    while ((status == true) &&
+            (emitted.fetchAndAddOrdered(1) < int(gotoPercent))) {
+        emit this->fileWorkTickSignal();
     }
-    // Clean up
-    mz_zip_reader_end(&zip);
+
     qDebug() << "Unzip complete";
     return status;
 }
@@ -291,22 +432,117 @@ int FileManager::checkFileInfo(const QString& file, bool lookGameDir) {
     return status;
 }
 
-QString FileManager::getExtraPath(const QString& levelDir) {
+// Modification times of the level directory and each directory down to
+// the game root, empty when one of them is missing. The root itself is
+// left out when a game was found there, the games save into it.
+static QString gameRootFingerprint(
+        const QString& levelPath, const QString& extraPath, int pattern) {
+    QStringList times(QString::number(pattern));
+    QString path = levelPath;
+    const QStringList parts = extraPath.split('/', Qt::SkipEmptyParts);
+    const int last = (pattern >= 0) ? parts.size() - 1 : parts.size();
+    bool status = true;
+    for (int i = -1; (i < last) && (status == true); i++) {
+        if (i >= 0) {
+            path += "/" + parts[i];
+        }
+        struct stat info;
+        status = (::stat(QFile::encodeName(path).constData(), &info) == 0);
+        times << QString("%1.%2")
+            .arg(info.st_mtim.tv_sec).arg(info.st_mtim.tv_nsec);
+    }
+    return (status == true) ? times.join('/') : QString();
+}
+
+// The paths of a game pattern under its root, spelled like on disk
+static QStringList gamePatternPaths(const QString& rootPath, int pattern) {
+    QStringList found;
+    for (const char* path : GAME_PATTERNS[pattern].paths) {
+        QString spelled;
+        QDir dir(rootPath);
+        const QStringList parts = (path != nullptr) ?
+            QString::fromLatin1(path).split('/') : QStringList();
+        for (const QString& part : parts) {
+            const QStringList names = dir.entryList({part},
+                QDir::AllEntries | QDir::Hidden | QDir::System);
+            const QString name = names.isEmpty() ? part : names.first();
+            spelled += (spelled.isEmpty() ? "" : "/") + name;
+            (void)dir.cd(name);
+        }
+        if (spelled.isEmpty() == false) {
+            found.append(spelled);
+        }
+    }
+    return found;
+}
+
+// The executable of a game pattern, the first in the root
+static QString gameExecutable(const QStringList& paths) {
+    QString exe;
+    for (const QString& path : paths) {
+        if ((exe.isEmpty() == true) && (path.contains('/') == false) &&
+                (path.endsWith(".exe", Qt::CaseInsensitive) == true)) {
+            exe = path;
+        }
+    }
+    return exe;
+}
+
+// Every path the game root was found by is still there
+static bool gamePathsExist(const QString& rootPath, const QStringList& paths) {
+    bool status = true;
+    for (const QString& path : paths) {
+        struct stat info;
+        status = status && (::stat(QFile::encodeName(
+            rootPath + "/" + path).constData(), &info) == 0);
+    }
+    return status;
+}
+
+QString FileManager::getExtraPath(const QString& levelDir, QString* exe) {
     const QString levelPath = QString("%1%2")
         .arg(m_levelDir.absolutePath(), levelDir);
-    StaticTrees staticTrees;
-    QDir dir(levelPath);
-    GameFileTree tree(dir);
-    tree.printTree(1);
-    QString extraPath;
-
-    for (const GameFileTree* stree : staticTrees.data) {
-        extraPath = tree.matchesFromAnyNode(stree);
-        if ((extraPath != QString("\0")) && (!extraPath.isEmpty())) {
+    QSettings roots(QString("%1%2%3")
+        .arg(m_levelDir.absolutePath(), m_sep, ".gameroots"),
+        QSettings::IniFormat);
+    roots.beginGroup(QDir::cleanPath(levelDir).section('/', -1));
+    QString extraPath = roots.value("root").toString();
+    QString exeName = roots.value("exe").toString();
+    QStringList paths = roots.value("paths").toStringList();
+    const int stored = roots.value("pattern", -1).toInt();
+    const QString fingerprint = roots.value("fingerprint").toString();
+
+    // Resolved before, no directory down to the root changed since and
+    // the files of the game are still in the root
+    if ((fingerprint.isEmpty() == true) || (fingerprint !=
+            gameRootFingerprint(levelPath, extraPath, stored)) ||
+            (gamePathsExist(levelPath + extraPath, paths) == false)) {
+        // Only the directories down to the game root are read
+        const int pattern = GameFileTree::findGameRoot(
+            levelPath, GAME_PATTERN_SET, &extraPath);
+        paths.clear();
+        if (pattern >= 0) {
+            paths = gamePatternPaths(levelPath + extraPath, pattern);
             QTextStream(stdout)
                 << "game tree matches: " << extraPath << Qt::endl;
-            break;
         }
+        exeName = gameExecutable(paths);
+        const QString now =
+            gameRootFingerprint(levelPath, extraPath, pattern);
+        if (now.isEmpty() == false) {
+            roots.setValue("root", extraPath);
+            roots.setValue("exe", exeName);
+            roots.setValue("paths", paths);
+            roots.setValue("pattern", pattern);
+            roots.setValue("fingerprint", now);
+        } else {
+            roots.remove("");
+        }
+    }
+    roots.endGroup();
+
+    if (exe != nullptr) {
+        *exe = exeName;
     }
     return levelPath + extraPath;
 }
@@ -384,7 +620,7 @@ qint64 FileManager::removeFileOrDirectory(
     QDir dir(path);
     if (dir.exists() == true) {
         // Remove directory and its contents
-        if (dir.removeRecursively() == true) {
+        if (FileBatch().removeTree(path) == true) {
             qDebug() << "Directory removed successfully:" << path;
             status = 0;
         } else {
@@ -429,6 +665,134 @@ int FileManager::createDirectory(const QString &file, bool gameDir) {
     return status;
 }
 
+bool FileManager::isReadOnlyAsset(const QString& path) {
+    // Level, sound and music files the games never write to
+    static const QStringList suffixes = {
+        "phd", "tr2", "tr4", "trc", "sfx", "pak", "wav", "mp3", "ogg"};
+    return suffixes.contains(QFileInfo(path).suffix().toLower());
+}
+
+bool FileManager::copyFileData(
+        const QString& source,
+        const QString& destination,
+        bool hardlink,
+        const std::function<void(qint64)>& progress,
+        const QAtomicInt* abort,
+        QString* error) {
+    const QByteArray from = QFile::encodeName(source);
+    const QByteArray to = QFile::encodeName(destination);
+    // Written next to the destination and renamed over it when complete,
+    // an existing file or hard link is never truncated through its name
+    const QByteArray temporary = to + "." + QByteArray::number(
+        QRandomGenerator::global()->generate(), 16) + ".part";
+    struct stat info;
+    struct stat target;
+    bool status = false;
+    bool whole = false;  // Linked or cloned, no bytes were copied
+    bool created = false;
+
+    const int in = ::open(from.constData(),  // flawfinder: ignore
+        O_RDONLY | O_CLOEXEC);
+    if ((in < 0) || (::fstat(in, &info) != 0)) {
+        *error = strerror(errno);
+    } else if ((::stat(to.constData(), &target) == 0) &&
+            (target.st_dev == info.st_dev) &&
+            (target.st_ino == info.st_ino)) {
+        // The game directory already resolves into the level directory
+        *error = "source and destination are the same file";
+    } else if (hardlink == true) {
+        // Falls back to a copy on another file system
+        status = (::link(from.constData(), temporary.constData()) == 0);
+        whole = status;
+        created = status;
+    }
+
+    if ((status == false) && (error->isEmpty() == true)) {
+        const int out = ::open(temporary.constData(),  // flawfinder: ignore
+            O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, info.st_mode & 0777);
+        created = (out >= 0);
+        if (out < 0) {
+            *error = strerror(errno);
+        } else if (::ioctl(out, FICLONE, in) == 0) {
+            // Shares the blocks on btrfs and xfs, nothing is copied
+            status = true;
+            whole = true;
+        } else {
+            const qint64 size = info.st_size;
+            qint64 done = 0;
+            bool kernel = true;
+
+            // Copied in the kernel, or on the server for NFS and SMB
+            while ((kernel == true) && (done < size) &&
+                    ((abort == nullptr) || (abort->loadAcquire() == 0))) {
+                const ssize_t n = ::copy_file_range(in, nullptr, out, nullptr,
+                    size_t(qMin<qint64>(size - done, 64 << 20)), 0);
+                if (n > 0) {
+                    done += n;
+                    if (progress != nullptr) {
+                        progress(n);
+                    }
+                } else if ((n < 0) && (done == 0) && ((errno == EXDEV) ||
+                        (errno == ENOSYS) || (errno == EOPNOTSUPP) ||
+                        (errno == EINVAL))) {
+                    kernel = false;
+                } else {
+                    *error = (n < 0) ? strerror(errno) : "file shrank";
+                    break;
+                }
+            }
+
+            if (kernel == false) {
+                QByteArray buffer(4 << 20, Qt::Uninitialized);
+                (void)::posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+                while ((done < size) && (error->isEmpty() == true) &&
+                        ((abort == nullptr) || (abort->loadAcquire() == 0))) {
+                    const ssize_t n = ::read(  // flawfinder: ignore
+                        in, buffer.data(), size_t(buffer.size()));
+                    if (n <= 0) {
+                        *error = (n < 0) ? strerror(errno) : "file shrank";
+                    } else if (::write(out, buffer.constData(), size_t(n))
+                            != n) {
+                        *error = strerror(errno);
+                    } else {
+                        done += n;
+                        if (progress != nullptr) {
+                            progress(n);
+                        }
+                    }
+                }
+            }
+            status = (error->isEmpty() == true) && (done == size);
+        }
+        if ((out >= 0) && (::close(out) != 0) && (status == true)) {
+            *error = strerror(errno);
+            status = false;
+        }
+    }
+    if (in >= 0) {
+        (void)::close(in);
+    }
+
+    if ((status == true) &&
+            (::rename(temporary.constData(), to.constData()) != 0)) {
+        *error = strerror(errno);
+        status = false;
+    }
+    if ((status == false) && (created == true)) {
+        // Only the temporary file goes, the destination is left as it was
+        (void)::unlink(temporary.constData());
+    }
+    if (status == false) {
+        whole = false;
+    }
+
+    // Linked and cloned files count all at once
+    if ((whole == true) && (progress != nullptr)) {
+        progress(info.st_size);
+    }
+    return status;
+}
+
 int FileManager::copyFile(const QString &gameFile,
         const QString &levelFile, bool fromGameDir) {
     int status = 0;
@@ -444,27 +808,204 @@ int FileManager::copyFile(const QString &gameFile,
 
     // Ensure the destination directory exists
     const QFileInfo destinationFileInfo(destinationFile);
-    QDir destinationDir(destinationFileInfo.absolutePath());
-    if (!destinationDir.exists() == true) {
-        if (!QDir().mkpath(destinationDir.absolutePath())) {
-            qDebug() << "Error creating destination directory.";
-            status = 1;
-        }
-    } else if (QFile::copy(sourceFile, destinationFile) == true) {
+    QString error;
+    if (!QDir().mkpath(destinationFileInfo.absolutePath())) {
+        qDebug() << "Error creating destination directory.";
+        status = 1;
+    } else if (QFile::exists(destinationFile) == true) {
+        qDebug() << "Target file already exist.";
+        status = 2;
+    } else if (copyFileData(sourceFile, destinationFile,
+            false, nullptr, nullptr, &error) == true) {
         qDebug() << "File copy to " << destinationFile << " successfully.";
         status = 0;
     } else {
-        if (QFile::exists(destinationFile) == true) {
-            qDebug() << "Target file already exist.";
-            status = 2;
-        } else {
-            qDebug() << "Failed to copy file: " << destinationFile;
-            status = 3;
-        }
+        qDebug() << "Failed to copy file: " << destinationFile << error;
+        status = 3;
     }
     return status;
 }
 
+QStringList FileManager::calculateMD5Batch(
+        const QStringList& files, bool lookGameDir) {
+    QStringList paths;
+    for (const QString& file : files) {
+        paths.append(FileManager::lookGameDir(file, lookGameDir));
+    }
+    return hashFiles(paths, nullptr);
+}
+
+QStringList FileManager::hashFiles(const QStringList& paths,
+        const std::function<void(qint64)>& progress) {
+    FileHashCache& hashCache = FileHashCache::getInstance();
+    QStringList sums;
+    QVector<qint64> unknown;
+    for (qint64 i = 0; i < paths.size(); i++) {
+        sums.append(hashCache.find(paths[i]));
+        if (sums.last().isEmpty() == true) {
+            unknown.append(i);
+        } else if (progress != nullptr) {
+            progress(QFileInfo(paths[i]).size());
+        }
+    }
+
+    // Each worker hashes a group of mapped files side by side in SIMD
+    // lanes, small enough groups to keep few files open at a time
+    const qint64 group = md5Lanes() * 8;
+    QMutex mutex;
+    QThreadPool pool;
+    for (qint64 first = 0; first < unknown.size(); first += group) {
+        const QVector<qint64> indexes = unknown.mid(first, group);
+        pool.start(QRunnable::create(
+                [&paths, &sums, &mutex, &hashCache, &progress, indexes]() {
+            static const unsigned char empty = 0;
+            std::vector<std::unique_ptr<QFile>> files;
+            std::vector<Md5Input> inputs;
+            QVector<qint64> mapped;
+            for (const qint64 index : indexes) {
+                auto file = std::make_unique<QFile>(paths[index]);
+                if (file->open(  // flawfinder: ignore
+                        QIODevice::ReadOnly) == false) {
+                    qWarning() << "Failed to open for MD5:" << paths[index];
+                } else if (file->size() == 0) {
+                    inputs.push_back({&empty, 0});
+                    mapped.append(index);
+                } else {
+                    const uchar* data = file->map(0, file->size());
+                    if (data == nullptr) {
+                        qWarning() << "Failed to map for MD5:"
+                            << paths[index];
+                    } else {
+                        inputs.push_back({data, size_t(file->size())});
+                        mapped.append(index);
+                    }
+                }
+                files.push_back(std::move(file));
+            }
+
+            std::vector<Md5Digest> digests(inputs.size());
+            md5Batch(inputs.data(), inputs.size(), digests.data());
+
+            for (qint64 i = 0; i < mapped.size(); i++) {
+                const QString sum = QString(QByteArray(
+                    reinterpret_cast<const char*>(digests[i].data()),
+                    16).toHex());
+                hashCache.insert(paths[mapped[i]], sum);
+                if (progress != nullptr) {
+                    progress(qint64(inputs[i].size));
+                }
+                QMutexLocker locker(&mutex);
+                sums[mapped[i]] = sum;
+            }
+        }));
+    }
+    pool.waitForDone();
+    return sums;
+}
+
+bool FileManager::copyVerifiedFiles(
+        const QVector<FileList>& list,
+        const QString& gameDir,
+        const QString& levelDir,
+        int ticks,
+        QString* failed,
+        bool linkAssets) {
+    struct Job {
+        QString path;
+        QString md5sum;
+        qint64 size;
+    };
+    QVector<Job> jobs;
+    QStringList sources;
+    qint64 total = 0;
+    for (const FileList& file : list) {
+        sources.append(lookGameDir(gameDir + file.path, true));
+        const qint64 size = QFileInfo(sources.last()).size();
+        jobs.append({file.path, file.md5sum, size});
+        total += size;
+    }
+
+    // Every byte is counted once when hashed and once when copied
+    QAtomicInteger<qint64> done(0);
+    QAtomicInt emitted(0);
+    auto progress = [this, &done, &emitted, total, ticks](qint64 bytes) {
+        const qint64 now = done.fetchAndAddOrdered(bytes) + bytes;
+        const int target = (total > 0) ?
+            int(qMin<qint64>(ticks, (now * ticks) / (2 * total))) : 0;
+        int current = emitted.loadAcquire();
+        while (current < target) {
+            if (emitted.testAndSetOrdered(current, current + 1) == true) {
+                emit this->fileWorkTickSignal();
+            }
+            current = emitted.loadAcquire();
+        }
+    };
+
+    // The whole list is checked before anything is written
+    failed->clear();
+    const QStringList sums = hashFiles(sources, progress);
+    for (qint64 i = 0; i < jobs.size(); i++) {
+        if (sums[i] != jobs[i].md5sum) {
+            qWarning() << "Original file was modified:" << jobs[i].path
+                << "had" << jobs[i].md5sum << "got" << sums[i];
+            *failed = jobs[i].path;
+            break;
+        }
+    }
+
+    if (failed->isEmpty() == true) {
+        // Largest first so the pool does not end waiting on one big file
+        std::stable_sort(jobs.begin(), jobs.end(),
+            [](const Job& a, const Job& b) { return a.size > b.size; });
+
+        QAtomicInt abort(0);
+        QMutex mutex;
+        auto copyOne = [this, &abort, &mutex, &progress, gameDir, levelDir,
+                linkAssets, failed](const Job& job) {
+            const QString sourcePath = lookGameDir(gameDir + job.path, true);
+            const QString destinationPath =
+                lookGameDir(levelDir + job.path, false);
+            QString error;
+
+            if (QDir().mkpath(
+                    QFileInfo(destinationPath).absolutePath()) == false) {
+                error = "could not create the directory";
+            } else if ((copyFileData(sourcePath, destinationPath,
+                    linkAssets && isReadOnlyAsset(job.path), progress,
+                    &abort, &error) == false) && (error.isEmpty() == true) &&
+                    (abort.loadAcquire() == 0)) {
+                error = "incomplete copy";
+            }
+
+            if (error.isEmpty() == false) {
+                QMutexLocker locker(&mutex);
+                // Only the first failure is reported, the rest were aborted
+                if (abort.testAndSetOrdered(0, 1) == true) {
+                    qWarning() << "Failed to copy" << job.path << ":"
+                        << error;
+                    *failed = job.path;
+                }
+            }
+        };
+
+        QThreadPool pool;
+        for (const Job& job : jobs) {
+            pool.start(QRunnable::create([&abort, &copyOne, job]() {
+                if (abort.loadAcquire() == 0) {
+                    copyOne(job);
+                }
+            }));
+        }
+        pool.waitForDone();
+    }
+
+    // Top up when stopped early or when there were no bytes to count
+    while (emitted.fetchAndAddOrdered(1) < ticks) {
+        emit this->fileWorkTickSignal();
+    }
+    return failed->isEmpty();
+}
+
 int FileManager::cleanWorkingDir(const QString &levelDir) {
     int status = 0;
     const QString directoryPath = QString("%1%2%3")
@@ -472,7 +1013,7 @@ int FileManager::cleanWorkingDir(const QString &levelDir) {
 
     QDir directory(directoryPath);
     if (directory.exists() == true) {
-        if (directory.removeRecursively() == true) {
+        if (FileBatch().removeTree(directoryPath) == true) {
             qDebug() << "Working Directory removed successfully.";
             status = 0;
         } else {
@@ -517,25 +1058,14 @@ bool FileManager::moveFilesToDirectory(
     QStringList entryFileList =
         dir.entryList(QDir::Files | QDir::NoDotAndDotDot);
 
-    // Move files and recursively move directories
-    return std::all_of(
-            entryFileList.cbegin(),
-            entryFileList.cend(),
-            [&](const QString& entry) -> bool {
-        bool status = true;
-
-        QString entryPath = QString("%1%2%3")
-            .arg(directoryFromPath, m_sep, entry);
-        QString destinationPath = QString("%1%2%3")
-            .arg(directoryToPath, m_sep, entry);
-
-        if (!QFile::rename(entryPath, destinationPath)) {
-            qWarning() << "Failed to move file from:"
-                << entryPath << "to:" << destinationPath;
-            status = false;
-        }
-        // cppcheck-suppress misra-c2012-15.5
-        return status;
-    });
+    // Files are renamed in one batch, directories are left where they are
+    QVector<QPair<QString, QString>> moves;
+    moves.reserve(entryFileList.size());
+    for (const QString& entry : qAsConst(entryFileList)) {
+        moves.append(qMakePair(
+            QString("%1%2%3").arg(directoryFromPath, m_sep, entry),
+            QString("%1%2%3").arg(directoryToPath, m_sep, entry)));
+    }
+    return FileBatch().renameFiles(moves);
 }
 
@@ -15,12 +15,17 @@
 #define SRC_FILEMANAGER_HPP_
 
 #include <QString>
+#include <QAtomicInt>
 #include <QObject>
 #include <QFile>
 #include <QDir>
 #include <QByteArray>
 #include <QCryptographicHash>
 #include <QDebug>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+#include "Data.hpp"
 
 class FileManager : public QObject {
     Q_OBJECT
@@ -33,7 +38,27 @@ class FileManager : public QObject {
     }
     const QString lookGameDir(const QString& file, bool lookGameDir);
     const QString calculateMD5(const QString& file, bool lookGameDir);
-    bool extractZip(const QString& zipFile, const QString& extractPath);
+    /**
+     * @brief MD5 of many files, hashed side by side on all cores.
+     *
+     * Files are mapped and hashed a group at a time in the SIMD lanes of
+     * md5Batch. Sums already in the FileHashCache are not calculated again.
+     *
+     * @return Hex sums in the order of the files, empty for unreadable ones.
+     */
+    QStringList calculateMD5Batch(const QStringList& files, bool lookGameDir);
+    /**
+     * @brief Extract a level archive into the level directory.
+     * @param[in] incremental Skip entries whose file on disk already has the
+     *            size and CRC-32 of the entry.
+     * @param[in] prune Remove files that are not in the archive.
+     * @return true if every entry was extracted or already up to date.
+     */
+    bool extractZip(
+        const QString& zipFile,
+        const QString& extractPath,
+        bool incremental = false,
+        bool prune = false);
     bool checkDir(const QString& file, bool lookGameDir);
     bool checkFile(const QString& file, bool lookGameDir);
     int checkFileInfo(const QString& file, bool lookGameDir);
@@ -53,10 +78,47 @@ class FileManager : public QObject {
         const QString& from,
         const QString& to);
 
+    /**
+     * @brief Copy game files to a level directory, checking every MD5.
+     *
+     * Every file is hashed with calculateMD5Batch first and nothing is
+     * written if one does not match. The files are then copied on a pool of
+     * workers, see copyFileData, and the first that can not be copied stops
+     * them all. One
+     * fileWorkTickSignal is emitted for each share of the bytes hashed and
+     * copied, always `ticks` in total.
+     *
+     * @param[in] list Files relative to both directories with their MD5.
+     * @param[in] gameDir Directory in the game directory to copy from.
+     * @param[in] levelDir Directory in the level directory to copy to.
+     * @param[in] ticks Number of progress ticks to emit.
+     * @param[out] failed The first file that failed, if any.
+     * @param[in] linkAssets Hard link level and sound files instead of
+     *            copying them, they are never written to by the games.
+     * @return true if every file matched and was copied.
+     */
+    bool copyVerifiedFiles(
+        const QVector<FileList>& list,
+        const QString& gameDir,
+        const QString& levelDir,
+        int ticks,
+        QString* failed,
+        bool linkAssets = false);
+
     int cleanWorkingDir(const QString &levelDir);
     bool backupGameDir(const QString &gameDir);
     bool linkGameDir(const QString& levelDir, const QString& gameDir);
-    QString getExtraPath(const QString& levelDir);
+    /**
+     * @brief Path to the directory in a level with the game files.
+     *
+     * Found once and kept in .gameroots in the level directory with the
+     * modification times of the directories above it and the files of the
+     * game in it. Later calls compare those times and check the files are
+     * still there. The root itself changes whenever a game is saved.
+     * @param[out] exe The game executable, empty when not known. May be
+     *             nullptr.
+     */
+    QString getExtraPath(const QString& levelDir, QString* exe = nullptr);
     bool ensureDirectoryExists(const QString& dirPath, const QDir& dir);
     bool setUpCamp(const QString& levelDir, const QString& gameDir);
 
@@ -65,6 +127,30 @@ class FileManager : public QObject {
 
  private:
     FileManager() {}
+    QStringList hashFiles(const QStringList& paths,
+        const std::function<void(qint64)>& progress);
+    static bool isReadOnlyAsset(const QString& path);
+    /**
+     * @brief Copy one file the cheapest way the file system allows.
+     *
+     * Tries a hard link when asked for, then a reflink with FICLONE, then
+     * copy_file_range and last a read and write loop with a large buffer.
+     * The data goes to a temporary file next to the destination that is
+     * renamed over it, so a failed copy leaves the destination untouched.
+     * Refuses when both paths are the same file.
+     *
+     * @param[in] progress Called with the bytes copied so far, may be empty.
+     * @param[in] abort Stops the copy when set to non zero, may be nullptr.
+     * @param[out] error Why the copy failed.
+     * @return true if the whole file was copied.
+     */
+    static bool copyFileData(
+        const QString& source,
+        const QString& destination,
+        bool hardlink,
+        const std::function<void(qint64)>& progress,
+        const QAtomicInt* abort,
+        QString* error);
 
     QDir m_levelDir;
     QDir m_gameDir;
@@ -0,0 +1,168 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "FilterIndex.hpp"
+#include <QtAlgorithms>
+
+Bitmap Bitmap::filled(qint64 size) {
+    Bitmap bitmap;
+    if (size > 0) {
+        bitmap.m_words.fill(~quint64(0), (size + 63) / 64);
+        if ((size % 64) != 0) {
+            bitmap.m_words.last() = (quint64(1) << (size % 64)) - 1;
+        }
+    }
+    return bitmap;
+}
+
+void Bitmap::set(qint64 row) {
+    const qint64 word = row / 64;
+    if (m_words.isEmpty() == true) {
+        m_first = word;
+        m_words.append(0);
+    } else if (word < m_first) {
+        m_words.insert(0, m_first - word, 0);
+        m_first = word;
+    } else if (word >= m_first + m_words.size()) {
+        m_words.resize(word - m_first + 1);
+    }
+    m_words[word - m_first] |= quint64(1) << (row % 64);
+}
+
+bool Bitmap::test(qint64 row) const {
+    const qint64 word = (row / 64) - m_first;
+    return (word >= 0) && (word < m_words.size()) &&
+        ((m_words[word] >> (row % 64)) & 1);
+}
+
+void Bitmap::intersect(const Bitmap& other) {
+    const qint64 first = qMax(m_first, other.m_first);
+    const qint64 end = qMin(m_first + m_words.size(),
+        other.m_first + other.m_words.size());
+    QVector<quint64> words;
+
+    if (first < end) {
+        words.resize(end - first);
+        for (qint64 i = 0; i < words.size(); i++) {
+            words[i] = m_words[first + i - m_first] &
+                other.m_words[first + i - other.m_first];
+        }
+    }
+    m_first = first;
+    m_words = words;
+    trim();
+}
+
+void Bitmap::unite(const Bitmap& other) {
+    if (other.m_words.isEmpty() == false) {
+        if (m_words.isEmpty() == true) {
+            *this = other;
+        } else {
+            const qint64 first = qMin(m_first, other.m_first);
+            const qint64 end = qMax(m_first + m_words.size(),
+                other.m_first + other.m_words.size());
+            QVector<quint64> words(end - first, 0);
+
+            for (qint64 i = 0; i < m_words.size(); i++) {
+                words[m_first - first + i] = m_words[i];
+            }
+            for (qint64 i = 0; i < other.m_words.size(); i++) {
+                words[other.m_first - first + i] |= other.m_words[i];
+            }
+            m_first = first;
+            m_words = words;
+        }
+    }
+}
+
+void Bitmap::trim() {
+    qint64 begin = 0;
+    qint64 end = m_words.size();
+    while ((begin < end) && (m_words[begin] == 0)) {
+        begin++;
+    }
+    while ((end > begin) && (m_words[end - 1] == 0)) {
+        end--;
+    }
+    if ((begin != 0) || (end != m_words.size())) {
+        m_words = m_words.mid(begin, end - begin);
+        m_first = m_words.isEmpty() ? 0 : m_first + begin;
+    }
+}
+
+qint64 Bitmap::count() const {
+    qint64 result = 0;
+    for (const quint64 word : m_words) {
+        result += qPopulationCount(word);
+    }
+    return result;
+}
+
+QVector<qint64> Bitmap::rows() const {
+    QVector<qint64> result;
+    result.reserve(count());
+    for (qint64 i = 0; i < m_words.size(); i++) {
+        quint64 word = m_words[i];
+        while (word != 0) {
+            result.append(((m_first + i) * 64) + qCountTrailingZeroBits(word));
+            word &= word - 1;
+        }
+    }
+    return result;
+}
+
+void FilterIndex::clear() {
+    m_size = 0;
+    m_type.clear();
+    m_class.clear();
+    m_difficulty.clear();
+    m_duration.clear();
+}
+
+void FilterIndex::add(qint64 row, qint64 type, qint64 classInput,
+        qint64 difficulty, qint64 duration) {
+    m_type[type].set(row);
+    m_class[classInput].set(row);
+    m_difficulty[difficulty].set(row);
+    m_duration[duration].set(row);
+    m_size = qMax(m_size, row + 1);
+}
+
+Bitmap FilterIndex::anyOf(
+        const QHash<qint64, Bitmap>& index, const QVector<qint64>& values) {
+    Bitmap result;
+    for (const qint64 value : values) {
+        auto it = index.constFind(value);
+        if (it != index.constEnd()) {
+            result.unite(it.value());
+        }
+    }
+    return result;
+}
+
+Bitmap FilterIndex::select(const FilterQuery& query) const {
+    Bitmap result = Bitmap::filled(m_size);
+    if (query.types.isEmpty() == false) {
+        result.intersect(anyOf(m_type, query.types));
+    }
+    if (query.classes.isEmpty() == false) {
+        result.intersect(anyOf(m_class, query.classes));
+    }
+    if (query.difficulties.isEmpty() == false) {
+        result.intersect(anyOf(m_difficulty, query.difficulties));
+    }
+    if (query.durations.isEmpty() == false) {
+        result.intersect(anyOf(m_duration, query.durations));
+    }
+    return result;
+}
@@ -0,0 +1,95 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SRC_FILTERINDEX_HPP_
+#define SRC_FILTERINDEX_HPP_
+
+#include <QHash>
+#include <QVector>
+
+/**
+ * @class Bitmap
+ * @brief A set of rows stored as 64 bit words.
+ *
+ * Only the words from the first to the last nonzero word are kept, so a
+ * value used by a run of levels costs only the span it covers.
+ */
+class Bitmap {
+ public:
+    /**
+     * @brief A bitmap with the rows 0 to size - 1 set.
+     */
+    static Bitmap filled(qint64 size);
+
+    void set(qint64 row);
+    bool test(qint64 row) const;
+    void intersect(const Bitmap& other);
+    void unite(const Bitmap& other);
+    qint64 count() const;
+    QVector<qint64> rows() const;
+
+ private:
+    void trim();
+
+    qint64 m_first = 0;           // Word index of m_words[0]
+    QVector<quint64> m_words;
+};
+
+/**
+ * @struct FilterQuery
+ * @brief The category IDs to show, from `StaticData`.
+ *
+ * A level must match every category that has values, and any one of the
+ * values in it. An empty category matches everything.
+ */
+struct FilterQuery {
+    QVector<qint64> types;
+    QVector<qint64> classes;
+    QVector<qint64> difficulties;
+    QVector<qint64> durations;
+
+    bool isEmpty() const {
+        return types.isEmpty() && classes.isEmpty() &&
+            difficulties.isEmpty() && durations.isEmpty();
+    }
+};
+
+/**
+ * @class FilterIndex
+ * @brief One bitmap of rows per type, class, difficulty and duration.
+ */
+class FilterIndex {
+ public:
+    void clear();
+    /**
+     * @brief Index a row, rows are added in order starting from 0.
+     */
+    void add(qint64 row, qint64 type, qint64 classInput,
+        qint64 difficulty, qint64 duration);
+    /**
+     * @brief The rows that match the query.
+     */
+    Bitmap select(const FilterQuery& query) const;
+
+ private:
+    static Bitmap anyOf(
+        const QHash<qint64, Bitmap>& index, const QVector<qint64>& values);
+
+    qint64 m_size = 0;
+    QHash<qint64, Bitmap> m_type;
+    QHash<qint64, Bitmap> m_class;
+    QHash<qint64, Bitmap> m_difficulty;
+    QHash<qint64, Bitmap> m_duration;
+};
+
+#endif  // SRC_FILTERINDEX_HPP_
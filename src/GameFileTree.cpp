@@ -25,34 +25,25 @@
  */
 
 #include "GameFileTree.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <QDir>
 #include <QFileInfo>
 #include <QQueue>
 #include <QTextStream>
+#include <vector>
 
-GameFileTree::GameFileTree(
-        const QString &fileName, GameFileTree *parent)
-    // cppcheck-suppress misra-c2012-12.3
-    : m_fileName(fileName), m_parentItem(parent)
-{}
+GameFileTree::~GameFileTree() {}
 
-GameFileTree::~GameFileTree() {
-    for (GameFileTree* child : m_childItems) {
-        delete child;
-    }
-}
-
-GameFileTree::GameFileTree(const QStringList& pathList)
-    // cppcheck-suppress misra-c2012-12.3
-    : m_parentItem(nullptr) {
+GameFileTree::GameFileTree(const QStringList& pathList) {
     addPathList(pathList);
 }
 
-GameFileTree::GameFileTree(const QDir &dir)
-    // cppcheck-suppress misra-c2012-12.3
-    : m_parentItem(nullptr) {
+GameFileTree::GameFileTree(const QDir &dir) {
+    QStringList pathList;
     if (dir.exists() == true) {
-        QStringList pathList;
         // Skapa en kö för att hantera kataloger iterativt
         QQueue<QString> dirQueue;
         const QString base = dir.absolutePath();
@@ -71,132 +62,403 @@ GameFileTree::GameFileTree(const QDir &dir)
                 QDir::Name);
 
             for (const QFileInfo& fileInfo : fileList) {
-                pathList << QString(fileInfo.absoluteFilePath().split(base)[1]);
+                const QString path = fileInfo.absoluteFilePath();
+                pathList << path.mid(base.size());
 
                 // Om objektet är en katalog, lägg till den i kön
                 if (fileInfo.isDir() == true) {
-                    dirQueue.enqueue(fileInfo.absoluteFilePath());
+                    dirQueue.enqueue(path);
                 }
             }
         }
-        addPathList(pathList);
     } else {
         QTextStream(stdout) << "Directory does not exist: "
             << dir.absolutePath() << Qt::endl;
     }
+    addPathList(pathList);
 }
 
 void GameFileTree::addPathList(const QStringList& pathList) {
+    // Every component adds its name and folded name at most once, so the
+    // pool never moves and the key views into it stay valid
+    qint64 total = 0;
     for (const QString& path : pathList) {
-        QStringList components = QDir::toNativeSeparators(path).split(
-            QDir::separator(), Qt::SkipEmptyParts);
-        GameFileTree* current = this;
-
-        for (const QString& component : components) {
-            // Check if a child node with this name already exists
-            auto it = std::find_if(
-                current->m_childItems.begin(), current->m_childItems.end(),
-                [&component](GameFileTree* child) {
-                    return child->m_fileName == component;
-            });
-
-            if (it == current->m_childItems.end()) {
-                // Node doesn't exist, create it
-                GameFileTree* newNode = new GameFileTree(component, current);
-                current->m_childItems.append(newNode);
-                current = newNode;
-            } else {
-                // Move to the existing node
-                current = *it;
+        total += path.size();
+    }
+    m_pool.reserve(int(total * 2));
+    m_nodes.reserve(pathList.size() + 1);
+    m_nodes.append({-1, -1, 0, 0, -1, -1, -1});
+
+    QString folded;
+    for (const QString& path : pathList) {
+        const QString native = QDir::toNativeSeparators(path);
+        qint32 current = 0;
+        int start = 0;
+
+        while (start < native.size()) {
+            int end = native.indexOf(QDir::separator(), start);
+            if (end < 0) {
+                end = native.size();
+            }
+            const int length = end - start;
+            if (length > 0) {
+                folded.resize(length);
+                for (int i = 0; i < length; i++) {
+                    folded[i] = native[start + i].toCaseFolded();
+                }
+                const qint32 key = intern(folded);
+                qint32 next = child(current, key);
+
+                if (next < 0) {
+                    // Node doesn't exist, create it
+                    next = m_nodes.size();
+                    m_nodes.append({current, key, m_pool.size(), length,
+                        -1, -1, -1});
+                    m_pool.append(native.constData() + start, length);
+                    Node& parent = m_nodes[current];
+                    if (parent.lastChild < 0) {
+                        parent.firstChild = next;
+                    } else {
+                        m_nodes[parent.lastChild].nextSibling = next;
+                    }
+                    parent.lastChild = next;
+                    m_children.insert(
+                        (quint64(current) << 32) | quint32(key), next);
+                }
+                current = next;
             }
+            start = end + 1;
         }
     }
 }
 
+qint32 GameFileTree::intern(const QString& folded) {
+    qint32 key = m_keyOf.value(QStringView(folded), -1);
+    if (key < 0) {
+        const QStringView view(m_pool.constData() + m_pool.size(),
+            folded.size());
+        m_pool.append(folded);
+        key = m_keys.size();
+        m_keys.append(view);
+        m_keyOf.insert(view, key);
+    }
+    return key;
+}
+
+qint32 GameFileTree::child(qint32 node, qint32 key) const {
+    return m_children.value((quint64(node) << 32) | quint32(key), -1);
+}
+
+QStringView GameFileTree::name(qint32 node) const {
+    return QStringView(m_pool.constData() + m_nodes[node].nameOffset,
+        m_nodes[node].nameLength);
+}
 
 void GameFileTree::printTree(int level) const {
-    // Build the current node's path by traversing up to the root
-    QString fullPath;
-    const GameFileTree* currentNode = this;
-
-    while (currentNode != nullptr) {
-        if (!currentNode->m_fileName.isEmpty()) {
-            if (fullPath.isEmpty()) {
-                fullPath = currentNode->m_fileName;
-            } else {
-                fullPath = QString("%1%2%3")
-                    .arg(currentNode->m_fileName)
+    (void)level;
+    QTextStream out(stdout);
+
+    // Depth first with the full path of each node built from its parent
+    QVector<QPair<qint32, QString>> stack;
+    stack.append({0, QString()});
+    while (stack.isEmpty() == false) {
+        const QPair<qint32, QString> current = stack.takeLast();
+        out << current.second << Qt::endl;
+
+        QVector<qint32> children;
+        for (qint32 c = m_nodes[current.first].firstChild; c >= 0;
+                c = m_nodes[c].nextSibling) {
+            children.append(c);
+        }
+        for (auto it = children.crbegin(); it != children.crend(); ++it) {
+            const QString childName = name(*it).toString();
+            stack.append({*it, current.second.isEmpty() ? childName :
+                QString("%1%2%3")
+                    .arg(current.second)
                     .arg(QDir::separator())
-                    .arg(fullPath);
-            }
+                    .arg(childName)});
         }
-        currentNode = currentNode->m_parentItem;
     }
+}
 
-    // Print the full path for this node
-    QTextStream(stdout) << fullPath << Qt::endl;
-
-    // Recursively call printTree on all child nodes
-    for (const GameFileTree* child : m_childItems) {
-        if (child != nullptr) {
-            child->printTree(level + 1);
-        }
+QVector<qint32> GameFileTree::keysOf(const GameFileTree* other) const {
+    // Keys of the other tree as keys of this one, -1 when not here at all
+    QVector<qint32> keys(other->m_keys.size(), -1);
+    for (qint32 key = 0; key < other->m_keys.size(); key++) {
+        keys[key] = m_keyOf.value(other->m_keys[key], -1);
     }
+    return keys;
 }
 
 bool GameFileTree::matchesSubtree(const GameFileTree* other) const {
     if (!other) return false;  // If the other tree is null, no match is possible.
+    return matchesSubtree(0, other, keysOf(other));
+}
 
-    QQueue<QPair<const GameFileTree*, const GameFileTree*>> queue;
-    queue.enqueue({this, other});  // Start with the root nodes of both trees.
-
-    while (!queue.isEmpty()) {
-        QPair<const GameFileTree*, const GameFileTree*> current = queue.dequeue();
+bool GameFileTree::matchesSubtree(qint32 node, const GameFileTree* other,
+        const QVector<qint32>& keys) const {
+    bool status = true;
+    QQueue<QPair<qint32, qint32>> queue;
+    queue.enqueue({node, 0});  // Start with the root of the other tree.
 
-        const GameFileTree* nodeThis = current.first;
-        const GameFileTree* nodeOther = current.second;
+    while ((status == true) && !queue.isEmpty()) {
+        const QPair<qint32, qint32> current = queue.dequeue();
 
-        // Check if all children in `nodeOther` match at least one child in `nodeThis`.
-        for (const GameFileTree* childOther : nodeOther->m_childItems) {
-            bool found = false;
-            for (const GameFileTree* childThis : nodeThis->m_childItems) {
-                if (childThis->m_fileName.toUpper() == childOther->m_fileName.toUpper()) {
-                    // Enqueue the matching child nodes for further comparison.
-                    queue.enqueue({childThis, childOther});
-                    found = true;
-                    break;
-                }
-            }
-
-            // If no matching child is found, the subtree does not match.
-            if (!found) {
-                return false;
+        // Every child in the other tree must have a child here by name
+        for (qint32 c = other->m_nodes[current.second].firstChild;
+                (c >= 0) && (status == true);
+                c = other->m_nodes[c].nextSibling) {
+            const qint32 key = keys[other->m_nodes[c].key];
+            const qint32 found = (key < 0) ? -1 : child(current.first, key);
+            if (found < 0) {
+                status = false;
+            } else {
+                queue.enqueue({found, c});
             }
         }
     }
-
-    return true;  // All nodes and structures matched successfully.
+    return status;
 }
 
 QString GameFileTree::matchesFromAnyNode(const GameFileTree* other) {
+    return (other == nullptr) ? QString() :
+        matchesFromNode(0, other, keysOf(other));
+}
+
+QString GameFileTree::matchesFromNode(qint32 node, const GameFileTree* other,
+        const QVector<qint32>& keys) const {
     // If this node matches the subtree, return its name
-    if (matchesSubtree(other)) {
-        return m_fileName;
+    if (matchesSubtree(node, other, keys)) {
+        return name(node).toString();
     }
 
     // Otherwise, check children recursively
-    for (GameFileTree* child : m_childItems) {
-        QString childPath = child->matchesFromAnyNode(other);
+    for (qint32 c = m_nodes[node].firstChild; c >= 0;
+            c = m_nodes[c].nextSibling) {
+        QString childPath = matchesFromNode(c, other, keys);
         if (!childPath.isEmpty()) {
             // Build the path backwards
             return QString("%1%2%3")
-                .arg(m_fileName)
+                .arg(name(node).toString())
                 .arg(QDir::separator())
                 .arg(childPath);
         }
     }
 
     // No match found
-    return QString("\0");
+    return QString();
+}
+
+// First pattern with all its paths in a directory, or -1
+static int firstPattern(quint32 found, const quint32* masks, int count) {
+    int pattern = -1;
+    for (int p = 0; (p < count) && (pattern < 0) && (found != 0); p++) {
+        if ((masks[p] != 0) && ((found & masks[p]) == masks[p])) {
+            pattern = p;
+        }
+    }
+    return pattern;
+}
+
+int GameFileTree::matchPatterns(const char* const* paths, int pathCount,
+        const quint32* masks, int patternCount, QString* path) const {
+    // Pattern paths as keys of this tree from the last name up, a path
+    // with a name not in the tree can not be found
+    struct Wanted {
+        quint32 bit;
+        QVector<qint32> keys;
+    };
+    QHash<qint32, QVector<Wanted>> byLastKey;
+    for (int bit = 0; bit < pathCount; bit++) {
+        const QStringList names = QString::fromLatin1(paths[bit])
+            .toCaseFolded().split('/', Qt::SkipEmptyParts);
+        QVector<qint32> keys;
+        bool known = (names.isEmpty() == false);
+        for (auto it = names.crbegin(); (it != names.crend()) && known; ++it) {
+            const qint32 key = m_keyOf.value(QStringView(*it), -1);
+            known = (key >= 0);
+            keys.append(key);
+        }
+        if (known == true) {
+            byLastKey[keys.first()].append({quint32(1) << bit, keys});
+        }
+    }
+
+    // Parents come before their children, so one pass finds every path
+    // and marks the directory it is found under
+    QVector<quint32> found(m_nodes.size(), 0);
+    QVector<qint32> depth(m_nodes.size(), 0);
+    for (qint32 node = 1; node < m_nodes.size(); node++) {
+        const Node& n = m_nodes[node];
+        depth[node] = depth[n.parent] + 1;
+        const auto wanted = byLastKey.constFind(n.key);
+        if (wanted != byLastKey.constEnd()) {
+            for (const Wanted& w : wanted.value()) {
+                qint32 at = n.parent;
+                int i = 1;
+                while ((at > 0) && (i < w.keys.size()) &&
+                        (m_nodes[at].key == w.keys[i])) {
+                    at = m_nodes[at].parent;
+                    i++;
+                }
+                if (i == w.keys.size()) {
+                    found[at] |= w.bit;
+                }
+            }
+        }
+    }
+
+    int best = -1;
+    qint32 bestNode = -1;
+    for (qint32 node = 0; node < m_nodes.size(); node++) {
+        const int p = firstPattern(found[node], masks, patternCount);
+        if ((p >= 0) && ((best < 0) || (depth[node] < depth[bestNode]) ||
+                ((depth[node] == depth[bestNode]) && (p < best)))) {
+            best = p;
+            bestNode = node;
+        }
+    }
+
+    path->clear();
+    for (qint32 node = bestNode; node > 0; node = m_nodes[node].parent) {
+        *path = QDir::separator() + name(node).toString() + *path;
+    }
+    return best;
 }
 
+namespace {
+struct Dirent64 {
+    quint64 d_ino;
+    qint64 d_off;
+    quint16 d_reclen;
+    quint8 d_type;
+    char d_name[1];  // flawfinder: ignore
+};
+
+struct DirectoryEntry {
+    QByteArray name;
+    QString folded;
+    bool directory;
+};
+
+// Directories deeper than this are not looked in
+constexpr int MAX_SCAN_DEPTH = 16;
+}  // namespace
+
+// Read a whole directory with getdents64, without following links
+static bool listDirectory(int fd, QVector<DirectoryEntry>* entries) {
+    bool status = true;
+    std::vector<char> buffer(32 * 1024);
+    long read = 0;
+    entries->clear();
+    while ((read = syscall(SYS_getdents64, fd,
+            buffer.data(), buffer.size())) > 0) {
+        for (long offset = 0; offset < read;) {
+            const Dirent64* entry =
+                reinterpret_cast<const Dirent64*>(buffer.data() + offset);
+            offset += entry->d_reclen;
+            const QByteArray name(entry->d_name);
+            if ((name != ".") && (name != "..")) {
+                bool directory = (entry->d_type == DT_DIR);
+                if (entry->d_type == DT_UNKNOWN) {
+                    struct stat info;
+                    directory = (fstatat(fd, entry->d_name, &info,
+                        AT_SYMLINK_NOFOLLOW) == 0) && S_ISDIR(info.st_mode);
+                }
+                entries->append({name,
+                    QFile::decodeName(name).toCaseFolded(), directory});
+            }
+        }
+    }
+    if (read < 0) {
+        status = false;
+    }
+    return status;
+}
+
+// If a path of folded names from a component on is under a directory
+static bool hasPath(int fd, const QVector<DirectoryEntry>& entries,
+        const QStringList& components, int component) {
+    bool status = false;
+    for (const DirectoryEntry& entry : entries) {
+        if ((status == false) && (entry.folded == components[component])) {
+            if (component + 1 == components.size()) {
+                status = true;
+            } else if (entry.directory == true) {
+                const int sub = openat(fd, entry.name.constData(),
+                    O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+                QVector<DirectoryEntry> subEntries;
+                if (sub >= 0) {
+                    status = listDirectory(sub, &subEntries) &&
+                        hasPath(sub, subEntries, components, component + 1);
+                    (void)::close(sub);
+                }
+            }
+        }
+    }
+    return status;
+}
+
+int GameFileTree::findGameRoot(const QString& root, const char* const* paths,
+        int pathCount, const quint32* masks, int patternCount,
+        QString* path) {
+    QVector<QStringList> wanted;
+    for (int bit = 0; bit < pathCount; bit++) {
+        wanted.append(QString::fromLatin1(paths[bit])
+            .toCaseFolded().split('/', Qt::SkipEmptyParts));
+    }
+
+    // One depth at a time, so the first depth with a match is the closest
+    // root and nothing below it is read
+    int best = -1;
+    QByteArray bestPath;
+    QVector<QByteArray> level = {QByteArray()};
+    const QByteArray rootName = QFile::encodeName(root);
+    const int rootFd = ::open(rootName.constData(),  // flawfinder: ignore
+        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    for (int depth = 0; (rootFd >= 0) && (best < 0) &&
+            (level.isEmpty() == false) && (depth <= MAX_SCAN_DEPTH); depth++) {
+        QVector<QByteArray> next;
+        for (const QByteArray& relative : qAsConst(level)) {
+            const int fd = relative.isEmpty() ? ::dup(rootFd) :
+                openat(rootFd, relative.constData(),
+                    O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+            QVector<DirectoryEntry> entries;
+            if ((fd >= 0) && (listDirectory(fd, &entries) == true)) {
+                quint32 found = 0;
+                for (int bit = 0; bit < wanted.size(); bit++) {
+                    if ((wanted[bit].isEmpty() == false) &&
+                            (hasPath(fd, entries, wanted[bit], 0) == true)) {
+                        found |= quint32(1) << bit;
+                    }
+                }
+                const int p = firstPattern(found, masks, patternCount);
+                if ((p >= 0) && ((best < 0) || (p < best))) {
+                    best = p;
+                    bestPath = relative;
+                }
+                for (const DirectoryEntry& entry : qAsConst(entries)) {
+                    if ((best < 0) && (entry.directory == true)) {
+                        next.append(relative.isEmpty() ? entry.name :
+                            relative + "/" + entry.name);
+                    }
+                }
+            }
+            if (fd >= 0) {
+                (void)::close(fd);
+            }
+        }
+        level = next;
+    }
+    if (rootFd >= 0) {
+        (void)::close(rootFd);
+    } else {
+        qWarning() << "Directory does not exist:" << root;
+    }
+
+    path->clear();
+    if (bestPath.isEmpty() == false) {
+        *path = QDir::separator() + QFile::decodeName(bestPath);
+    }
+    return best;
+}
@@ -15,12 +15,86 @@
 #define SRC_GAMEFILETREE_HPP_
 
 #include <QString>
+#include <QStringView>
 #include <QVector>
 #include <QDir>
+#include <QHash>
 #include <QStringList>
 #include <QDebug>
 #include <QList>
+#include <array>
 
+/**
+ * @brief Paths that are all found under the root of one kind of game.
+ *
+ * Paths use '/' and are matched case folded, unused paths are nullptr.
+ */
+struct GamePattern {
+    std::array<const char*, 5> paths;
+};
+
+/**
+ * @brief Game patterns with every distinct path given one bit.
+ *
+ * Made at compile time by compileGamePatterns(), a pattern matches a
+ * directory when all bits in its mask are found under it.
+ */
+template <std::size_t N>
+struct GamePatternSet {
+    static constexpr int MAX_PATHS = 32;
+    std::array<const char*, MAX_PATHS> paths {};
+    int pathCount = 0;
+    std::array<quint32, N> masks {};
+    bool overflow = false;      // More distinct paths than bits
+};
+
+constexpr bool samePatternPath(const char* a, const char* b) {
+    auto lower = [](char c) {
+        return ((c >= 'A') && (c <= 'Z')) ? char(c - 'A' + 'a') : c;
+    };
+    while ((*a != '\0') && (lower(*a) == lower(*b))) {
+        a++;
+        b++;
+    }
+    return lower(*a) == lower(*b);
+}
+
+template <std::size_t N>
+constexpr GamePatternSet<N> compileGamePatterns(
+        const std::array<GamePattern, N>& patterns) {
+    GamePatternSet<N> set;
+    for (std::size_t p = 0; p < N; p++) {
+        for (const char* path : patterns[p].paths) {
+            if (path != nullptr) {
+                int bit = 0;
+                while ((bit < set.pathCount) &&
+                        !samePatternPath(set.paths[bit], path)) {
+                    bit++;
+                }
+                if (bit == set.pathCount) {
+                    if (bit == GamePatternSet<N>::MAX_PATHS) {
+                        set.overflow = true;
+                        continue;
+                    }
+                    set.paths[bit] = path;
+                    set.pathCount++;
+                }
+                set.masks[p] |= quint32(1) << bit;
+            }
+        }
+    }
+    return set;
+}
+
+/**
+ * @class GameFileTree
+ * @brief A tree of file names to recognise game directories by.
+ *
+ * All nodes are kept in one array and all names in one string pool,
+ * so a tree costs a few allocations whatever its size. Names are looked
+ * up case folded, each distinct folded name gets a key once, and the
+ * children of every node are found through one hash on parent and key.
+ */
 class GameFileTree {
  public:
     explicit GameFileTree(const QDir& fullPath);
@@ -30,15 +104,70 @@ class GameFileTree {
     void printTree(int level) const;
     bool matchesSubtree(const GameFileTree* other) const;
     QString matchesFromAnyNode(const GameFileTree* other);
+    /**
+     * @brief Find the directory matched by the first pattern that matches.
+     *
+     * All patterns are tested in one pass over the tree. The directory
+     * closest to the root wins, then the pattern earlier in the set.
+     * @param[out] path The directory with a leading separator, empty for
+     * the root of the tree.
+     * @return Index of the pattern that matched or -1.
+     */
+    template <std::size_t N>
+    int matchPatterns(const GamePatternSet<N>& set, QString* path) const {
+        return matchPatterns(set.paths.data(), set.pathCount,
+            set.masks.data(), int(N), path);
+    }
+    /**
+     * @brief Find the game root under a directory without a whole tree.
+     *
+     * Directories are read with getdents64 one depth at a time and the
+     * patterns tested on each. The scan stops at the first depth with a
+     * match, the files below it are never read. Symbolic links to
+     * directories are not followed.
+     * @param[out] path The directory with a leading separator, empty for
+     * the root directory.
+     * @return Index of the pattern that matched or -1.
+     */
+    template <std::size_t N>
+    static int findGameRoot(const QString& root,
+            const GamePatternSet<N>& set, QString* path) {
+        return findGameRoot(root, set.paths.data(), set.pathCount,
+            set.masks.data(), int(N), path);
+    }
 
  private:
-    explicit GameFileTree(
-        const QString &fileName, GameFileTree *parentItem);
+    struct Node {
+        qint32 parent;
+        qint32 key;             // Interned case folded name
+        qint32 nameOffset;      // Name as first seen, in m_pool
+        qint32 nameLength;
+        qint32 firstChild;      // Children in the order they were added
+        qint32 lastChild;
+        qint32 nextSibling;
+    };
+
     void addPathList(const QStringList& pathList);
-    void addNode(GameFileTree* node);  // maybe dont need this
-    QVector<GameFileTree*> m_childItems;
-    QString m_fileName;
-    GameFileTree *m_parentItem;
+    qint32 intern(const QString& folded);
+    qint32 child(qint32 node, qint32 key) const;
+    QStringView name(qint32 node) const;
+    QVector<qint32> keysOf(const GameFileTree* other) const;
+    int matchPatterns(const char* const* paths, int pathCount,
+        const quint32* masks, int patternCount, QString* path) const;
+    static int findGameRoot(const QString& root, const char* const* paths,
+        int pathCount, const quint32* masks, int patternCount,
+        QString* path);
+    bool matchesSubtree(qint32 node, const GameFileTree* other,
+        const QVector<qint32>& keys) const;
+    QString matchesFromNode(qint32 node, const GameFileTree* other,
+        const QVector<qint32>& keys) const;
+
+    QVector<Node> m_nodes;              // The root is node 0
+    QString m_pool;                     // Never grows past its reserve
+    QVector<QStringView> m_keys;        // Folded name of each key
+    QHash<QStringView, qint32> m_keyOf;
+    QHash<quint64, qint32> m_children;  // Parent and key to child
+    Q_DISABLE_COPY(GameFileTree)
 };
 
 #endif  // SRC_GAMEFILETREE_HPP_
@@ -0,0 +1,412 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "LevelListModel.hpp"
+#include <QHash>
+#include <QPixmap>
+#include <algorithm>
+#include "ThumbnailCache.hpp"
+#include "staticData.hpp"
+
+LevelListModel::LevelListModel(QObject* parent)
+        : QAbstractListModel(parent), m_covers(64) {
+    // Covers asked for while painting are loaded together afterwards
+    m_coverTimer.setSingleShot(true);
+    m_coverTimer.setInterval(0);
+    connect(&m_coverTimer, SIGNAL(timeout()), this, SLOT(loadCovers()));
+    setCoverSize(m_coverSize);
+    m_searchPool.setMaxThreadCount(1);
+}
+
+void LevelListModel::setCoverSize(const QSize& size) {
+    QPixmap placeholder(size);
+    placeholder.fill(Qt::transparent);
+    m_placeholder = QIcon(placeholder);
+    m_coverSize = size;
+    m_covers.clear();
+}
+
+int LevelListModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : m_order.size();
+}
+
+QVariant LevelListModel::data(const QModelIndex& index, int role) const {
+    QVariant value;
+    if (index.isValid() && (index.row() < m_order.size())) {
+        const qint64 entry = m_order[index.row()];
+        const Entry& e = m_entries[entry];
+        if (role == Qt::DisplayRole) {
+            value = e.text;
+        } else if (role == Qt::DecorationRole) {
+            if (e.storeRow < 0) {
+                value = e.icon;
+            } else if (m_covers.contains(entry) == true) {
+                value = *m_covers.object(entry);
+            } else {
+                value = m_placeholder;
+            }
+        } else if (role == Qt::UserRole) {
+            value = e.id;
+        } else if ((role == Qt::UserRole + 1) && (e.storeRow < 0)) {
+            value = e.linkedGameDir;
+        }
+    }
+    return value;
+}
+
+bool LevelListModel::setData(
+        const QModelIndex& index, const QVariant& value, int role) {
+    bool status = false;
+    if (index.isValid() && (index.row() < m_order.size()) &&
+            (role == Qt::UserRole + 1)) {
+        Entry& e = m_entries[m_order[index.row()]];
+        if (e.storeRow < 0) {
+            e.linkedGameDir = value.toBool();
+            emit dataChanged(index, index, {role});
+            status = true;
+        }
+    }
+    return status;
+}
+
+void LevelListModel::updateRows() {
+    m_rowOf.fill(-1, m_entries.size());
+    for (qint64 row = 0; row < m_order.size(); row++) {
+        m_rowOf[m_order[row]] = row;
+    }
+}
+
+bool LevelListModel::passesFilter(qint64 entry) const {
+    const qint64 storeRow = m_entries[entry].storeRow;
+    return m_filter.isEmpty() ||
+        ((storeRow >= 0) && (m_selected.test(storeRow) == true));
+}
+
+QVector<qint64> LevelListModel::filtered(const QVector<qint64>& order) const {
+    QVector<qint64> result;
+    if (m_filter.isEmpty() == true) {
+        result = order;
+    } else {
+        result.reserve(order.size());
+        for (const qint64 entry : order) {
+            if (passesFilter(entry) == true) {
+                result.append(entry);
+            }
+        }
+    }
+    return result;
+}
+
+void LevelListModel::setFilter(const FilterQuery& query) {
+    m_filter = query;
+    m_selected = m_filterIndex.select(m_filter);
+    beginResetModel();
+    m_order = filtered(m_baseOrder);
+    updateRows();
+    endResetModel();
+}
+
+void LevelListModel::setOriginalGames(const QList<int>& availableGames) {
+    const QString pictures = ":/pictures/";
+    OriginalGameData pictureData;
+
+    beginResetModel();
+    m_entries.clear();
+    m_baseOrder.clear();
+    m_order.clear();
+    m_storeEntry.clear();
+    m_store.clear();
+    m_filterIndex.clear();
+    m_trigrams.clear();
+    m_selected = m_filterIndex.select(m_filter);
+    m_covers.clear();
+    m_pending.clear();
+    m_missing.clear();
+
+    for (const int id : availableGames) {
+        // A negative id means the game directory is not linked yet
+        const int idPositive = (id < 0) ? -id : id;
+        Entry e;
+        e.id = -idPositive;
+        e.text = QString("Tomb Raider %1 Original")
+            .arg(pictureData.romanNumerals[idPositive]);
+        e.icon = QIcon(pictures + pictureData.getPicture(idPositive));
+        e.linkedGameDir = (id > 0);
+        // Searches only find levels
+        if (m_searching == false) {
+            m_baseOrder.append(m_entries.size());
+        }
+        m_entries.append(e);
+    }
+    m_order = filtered(m_baseOrder);
+    updateRows();
+    endResetModel();
+}
+
+void LevelListModel::appendLevels(const QVector<ListItemData>& list) {
+    StaticData staticData;
+    auto mapType = staticData.getType();
+    auto mapClass = staticData.getClass();
+    auto mapDifficulty = staticData.getDifficulty();
+    auto mapDuration = staticData.getDuration();
+
+    const qint64 firstEntry = m_entries.size();
+    for (const ListItemData& item : list) {
+        Entry e;
+        e.id = item.m_id;
+        e.text = QString("%1 by %2\n").arg(item.m_title, item.m_author);
+        e.text += QString(
+                "Type: %1\nClass: %2\nDifficulty: %3\n"
+                "Duration: %4\nDate:%5")
+            .arg(mapType.at(item.m_type))
+            .arg(mapClass.at(item.m_class))
+            .arg(mapDifficulty.at(item.m_difficulty))
+            .arg(mapDuration.at(item.m_duration))
+            .arg(item.m_releaseDate);
+        e.storeRow = m_store.append(item);
+        e.pictureId = item.m_pictureId;
+        e.pictureHash = item.m_pictureHash;
+        // Covers that could not be cached come with the item
+        e.picture = item.m_picture;
+
+        m_filterIndex.add(e.storeRow, item.m_type, item.m_class,
+            item.m_difficulty, item.m_duration);
+        m_trigrams.add(item.m_id, item.m_title, item.m_author);
+        m_storeEntry.append(m_entries.size());
+        if (m_searching == false) {
+            m_baseOrder.append(m_entries.size());
+        }
+        m_entries.append(e);
+    }
+    if (m_filter.isEmpty() == false) {
+        m_selected = m_filterIndex.select(m_filter);
+    }
+
+    QVector<qint64> added;
+    for (qint64 entry = firstEntry;
+            (m_searching == false) && (entry < m_entries.size()); entry++) {
+        if (passesFilter(entry) == true) {
+            added.append(entry);
+        }
+    }
+    if (added.isEmpty() == false) {
+        beginInsertRows(QModelIndex(),
+            m_order.size(), m_order.size() + added.size() - 1);
+        m_order.append(added);
+        updateRows();
+        endInsertRows();
+    } else {
+        updateRows();
+    }
+
+    // While searching the new levels are shown once the search finds them
+    if ((m_searching == true) && (m_fuzzyText.isEmpty() == false)) {
+        fuzzySearch(m_fuzzyText, m_fuzzyField);
+    } else if (m_searching == true) {
+        bool found = false;
+        for (const ListItemData& item : list) {
+            found = found || m_searchIds.contains(item.m_id);
+        }
+        if (found == true) {
+            showIds(m_searchIds);
+        }
+    }
+}
+
+void LevelListModel::setOrder(const QVector<qint64>& order) {
+    emit layoutAboutToBeChanged();
+    const QModelIndexList oldList = persistentIndexList();
+    QVector<qint64> oldEntries;
+    oldEntries.reserve(oldList.size());
+    for (const QModelIndex& index : oldList) {
+        oldEntries.append(m_order[index.row()]);
+    }
+
+    m_order = order;
+    updateRows();
+
+    QModelIndexList newList;
+    newList.reserve(oldList.size());
+    for (const qint64 entry : oldEntries) {
+        const qint64 row = m_rowOf[entry];
+        newList.append((row >= 0) ? index(int(row)) : QModelIndex());
+    }
+    changePersistentIndexList(oldList, newList);
+    emit layoutChanged();
+}
+
+void LevelListModel::sort(LevelStore::Column column, bool originalFirst) {
+    QVector<qint64> originals;
+    QVector<qint64> rows;
+    rows.reserve(m_baseOrder.size());
+    for (const qint64 entry : m_baseOrder) {
+        if (m_entries[entry].storeRow < 0) {
+            originals.append(entry);
+        } else {
+            rows.append(m_entries[entry].storeRow);
+        }
+    }
+    std::sort(originals.begin(), originals.end());
+
+    m_store.sort(column, &rows);
+
+    QVector<qint64> order;
+    order.reserve(m_baseOrder.size());
+    if (originalFirst == true) {
+        order.append(originals);
+    }
+    for (const qint64 row : rows) {
+        order.append(m_storeEntry[row]);
+    }
+    if (originalFirst == false) {
+        order.append(originals);
+    }
+    m_baseOrder = order;
+    setOrder(filtered(m_baseOrder));
+}
+
+void LevelListModel::showOnly(const QVector<qint64>& ids) {
+    m_fuzzyText.clear();
+    showIds(ids);
+}
+
+void LevelListModel::showIds(const QVector<qint64>& ids) {
+    m_searching = true;
+    m_searchIds = ids;
+    QHash<qint64, qint64> entryOf;
+    for (qint64 entry = 0; entry < m_entries.size(); entry++) {
+        entryOf.insert(m_entries[entry].id, entry);
+    }
+
+    beginResetModel();
+    m_baseOrder.clear();
+    for (const qint64 id : ids) {
+        if ((id > 0) && entryOf.contains(id)) {
+            m_baseOrder.append(entryOf.value(id));
+        }
+    }
+    m_order = filtered(m_baseOrder);
+    updateRows();
+    endResetModel();
+}
+
+void LevelListModel::showAll() {
+    m_searching = false;
+    m_searchIds.clear();
+    m_fuzzyText.clear();
+    beginResetModel();
+    m_baseOrder.resize(m_entries.size());
+    for (qint64 entry = 0; entry < m_entries.size(); entry++) {
+        m_baseOrder[entry] = entry;
+    }
+    m_order = filtered(m_baseOrder);
+    updateRows();
+    endResetModel();
+}
+
+void LevelListModel::fuzzySearch(const QString& text, int field) {
+    m_searching = true;
+    m_fuzzyText = text;
+    m_fuzzyField = field;
+    const int generation = m_searchGeneration.fetchAndAddOrdered(1) + 1;
+    // Searches still waiting are stale now
+    m_searchPool.clear();
+    m_searchPool.start(QRunnable::create([this, text, field, generation]() {
+        const QVector<qint64> ids = m_trigrams.search(
+            text, field, &m_searchGeneration, generation);
+        (void)QMetaObject::invokeMethod(this, [this, ids, generation]() {
+            if (m_searchGeneration.loadAcquire() == generation) {
+                showIds(ids);
+            }
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void LevelListModel::searchAgain() {
+    if ((m_searching == true) && (m_fuzzyText.isEmpty() == false)) {
+        fuzzySearch(m_fuzzyText, m_fuzzyField);
+    } else if (m_searching == true) {
+        showIds(m_searchIds);
+    }
+}
+
+void LevelListModel::cancelSearch() {
+    (void)m_searchGeneration.fetchAndAddOrdered(1);
+}
+
+void LevelListModel::refreshCovers() {
+    m_covers.clear();
+    m_missing.clear();
+    if (m_order.isEmpty() == false) {
+        emit dataChanged(index(0), index(m_order.size() - 1),
+            {Qt::DecorationRole});
+    }
+}
+
+void LevelListModel::requestCover(int row) {
+    if ((row >= 0) && (row < m_order.size())) {
+        const qint64 entry = m_order[row];
+        if ((m_entries[entry].storeRow >= 0) &&
+                (m_covers.contains(entry) == false) &&
+                (m_missing.contains(entry) == false)) {
+            m_pending.insert(entry);
+            if (m_coverTimer.isActive() == false) {
+                m_coverTimer.start();
+            }
+        }
+    }
+}
+
+void LevelListModel::loadCovers() {
+    ThumbnailCache& cache = ThumbnailCache::getInstance();
+    qint64 first = m_order.size();
+    qint64 last = -1;
+
+    for (const qint64 entry : qAsConst(m_pending)) {
+        const Entry& e = m_entries[entry];
+        QImage image = e.picture;
+        if (image.isNull() == true) {
+            image = cache.findImage(
+                e.pictureId, e.pictureHash, ListItemData::coverSize());
+        }
+
+        if (image.isNull() == true) {
+            m_missing.insert(entry);
+        } else {
+            // Scaled to the icon size so the mapped card is released now
+            const QPixmap pixmap = QPixmap::fromImage(image.scaled(
+                m_coverSize, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+            (void)m_covers.insert(entry, new QIcon(pixmap));
+            const qint64 row = m_rowOf[entry];
+            if (row >= 0) {
+                first = qMin(first, row);
+                last = qMax(last, row);
+            }
+        }
+    }
+    m_pending.clear();
+
+    // One signal for the whole batch, the view repaints what it shows
+    if (last >= 0) {
+        emit dataChanged(index(int(first)), index(int(last)),
+            {Qt::DecorationRole});
+    }
+}
+
+void LevelDelegate::paint(
+        QPainter* painter,
+        const QStyleOptionViewItem& option,
+        const QModelIndex& index) const {
+    m_model->requestCover(index.row());
+    QStyledItemDelegate::paint(painter, option, index);
+}
@@ -0,0 +1,208 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SRC_LEVELLISTMODEL_HPP_
+#define SRC_LEVELLISTMODEL_HPP_
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QIcon>
+#include <QMap>
+#include <QSet>
+#include <QSize>
+#include <QStyledItemDelegate>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+#include "Data.hpp"
+#include "FilterIndex.hpp"
+#include "LevelStore.hpp"
+#include "TrigramIndex.hpp"
+
+struct OriginalGameData {
+    QMap<int, QString> romanNumerals = {
+            {0, "null"},
+            {1, "I"},
+            {2, "II"},
+            {3, "III"},
+            {4, "IV"},
+            {5, "V"},
+            {6, "VI"},
+            {7, "IUB"},
+            {8, "IIGM"},
+            {9, "IIILM"},
+    };
+    const QString getPicture(int id) {
+        return QString ("Tomb_Raider_%1.jpg").arg(romanNumerals[id]);
+    }
+};
+
+/**
+ * @class LevelListModel
+ * @brief The original games and levels shown in the level browser.
+ *
+ * Rows only hold text and ids. Covers are loaded from the thumbnail cache
+ * when the delegate paints a row, a few at a time, and kept in a small
+ * LRU cache. Sorting and searching only reorder entry numbers, and the
+ * category filter is applied on top of them with a bitmap of store rows.
+ * Titles and authors go into a trigram index as batches arrive, so typed
+ * text can be matched while the list is still loading.
+ *
+ * Roles: `Qt::DisplayRole` the card text, `Qt::DecorationRole` the cover,
+ * `Qt::UserRole` the id, negative for original games, and
+ * `Qt::UserRole + 1` if the original game directory is linked.
+ */
+class LevelListModel : public QAbstractListModel {
+    Q_OBJECT
+
+ public:
+    explicit LevelListModel(QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role) const override;
+    bool setData(
+        const QModelIndex& index, const QVariant& value, int role) override;
+
+    /**
+     * @brief Start over with only the original games.
+     */
+    void setOriginalGames(const QList<int>& availableGames);
+    /**
+     * @brief Add a batch of levels at the end of the list.
+     */
+    void appendLevels(const QVector<ListItemData>& list);
+    /**
+     * @brief Sort the shown rows by a column.
+     * @param[in] originalFirst Put the original games on top, else last.
+     */
+    void sort(LevelStore::Column column, bool originalFirst);
+    /**
+     * @brief Show only these levels in this order.
+     *
+     * Levels added later are shown when they are in the list of ids.
+     */
+    void showOnly(const QVector<qint64>& ids);
+    /**
+     * @brief Show every entry again in the order it was added.
+     */
+    void showAll();
+    /**
+     * @brief Show the levels whose title or author is close to the text.
+     *
+     * The search runs on a worker thread and the result replaces the shown
+     * rows. Each call cancels the search started before it. It runs again
+     * when more levels are added, until showAll() or showOnly().
+     * @param[in] field 0 matches titles, 1 authors.
+     */
+    void fuzzySearch(const QString& text, int field);
+    /**
+     * @brief Drop the result of a running fuzzy search.
+     */
+    void cancelSearch();
+    /**
+     * @brief Run the shown search again, after the list was rebuilt.
+     */
+    void searchAgain();
+    /**
+     * @brief If a search result is shown or on the way.
+     */
+    bool searching() const { return m_searching; }
+    /**
+     * @brief Show only the levels in these categories.
+     *
+     * The original games have no categories and are hidden while any
+     * category is filtered.
+     */
+    void setFilter(const FilterQuery& query);
+    /**
+     * @brief Forget loaded covers, they are loaded again when painted.
+     */
+    void refreshCovers();
+    /**
+     * @brief Ask for the cover of a row, called by the delegate on paint.
+     */
+    void requestCover(int row);
+    void setCoverSize(const QSize& size);
+
+ private slots:
+    void loadCovers();
+
+ private:
+    struct Entry {
+        qint64 id = 0;
+        QString text;
+        qint64 storeRow = -1;     // -1 for the original games
+        qint64 pictureId = 0;
+        QByteArray pictureHash;
+        QImage picture;           // Only when the card is not in the cache
+        QIcon icon;               // Only for the original games
+        bool linkedGameDir = false;
+    };
+
+    void setOrder(const QVector<qint64>& order);
+    void showIds(const QVector<qint64>& ids);
+    void updateRows();
+    bool passesFilter(qint64 entry) const;
+    QVector<qint64> filtered(const QVector<qint64>& order) const;
+
+    QVector<Entry> m_entries;
+    QVector<qint64> m_baseOrder;    // Entries sorted or searched for
+    QVector<qint64> m_order;        // The base order that passes the filter
+    QVector<qint64> m_rowOf;        // Row of each entry, -1 when not shown
+    QVector<qint64> m_storeEntry;   // Entry of each LevelStore row
+    LevelStore m_store;
+    FilterIndex m_filterIndex;      // By LevelStore row
+    FilterQuery m_filter;
+    Bitmap m_selected;              // Store rows that pass m_filter
+
+    QCache<qint64, QIcon> m_covers;
+    QSet<qint64> m_pending;
+    QSet<qint64> m_missing;
+    QTimer m_coverTimer;
+    QSize m_coverSize = ListItemData::coverSize();
+    QIcon m_placeholder;
+
+    // New levels are kept out of the shown rows while searching
+    bool m_searching = false;
+    QVector<qint64> m_searchIds;    // Levels of the last search result
+    QString m_fuzzyText;            // Searched again as levels arrive
+    int m_fuzzyField = 0;
+    TrigramIndex m_trigrams;
+    QAtomicInt m_searchGeneration;  // Bumped by every search and cancel
+    QThreadPool m_searchPool;       // Last, waits for the search on exit
+};
+
+/**
+ * @class LevelDelegate
+ * @brief Paints level cards and asks the model for covers of painted rows.
+ *
+ * All rows have the same size, so the view never has to look at rows
+ * outside the viewport.
+ */
+class LevelDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+
+ public:
+    LevelDelegate(LevelListModel* model, QObject* parent = nullptr)
+        : QStyledItemDelegate(parent), m_model(model) {}
+
+    void paint(
+        QPainter* painter,
+        const QStyleOptionViewItem& option,
+        const QModelIndex& index) const override;
+
+ private:
+    LevelListModel* m_model;
+};
+
+#endif  // SRC_LEVELLISTMODEL_HPP_
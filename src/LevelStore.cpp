@@ -0,0 +1,80 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "LevelStore.hpp"
+#include <QDate>
+#include <algorithm>
+
+qint64 LevelStore::append(const ListItemData& item) {
+    const QDate date = QDate::fromString(item.m_releaseDate, "dd-MMM-yyyy");
+
+    m_id.append(item.m_id);
+    m_title.append(item.m_title.toCaseFolded());
+    m_author.append(item.m_author.toCaseFolded());
+    m_type.append(item.m_type);
+    m_class.append(item.m_class);
+    m_difficulty.append(item.m_difficulty);
+    m_duration.append(item.m_duration);
+    m_releaseDay.append(date.isValid() ? date.toJulianDay() : 0);
+    return m_id.size() - 1;
+}
+
+void LevelStore::clear() {
+    m_id.clear();
+    m_title.clear();
+    m_author.clear();
+    m_type.clear();
+    m_class.clear();
+    m_difficulty.clear();
+    m_duration.clear();
+    m_releaseDay.clear();
+}
+
+qint64 LevelStore::size() const {
+    return m_id.size();
+}
+
+bool LevelStore::descending(Column column) {
+    return (column != Title) && (column != Author);
+}
+
+const QVector<qint64>& LevelStore::numbers(Column column) const {
+    switch (column) {
+        case Type:
+            return m_type;
+        case Class:
+            return m_class;
+        case Difficulty:
+            return m_difficulty;
+        case Duration:
+            return m_duration;
+        default:
+            return m_releaseDay;
+    }
+}
+
+void LevelStore::sort(Column column, QVector<qint64>* rows) const {
+    if ((column == Title) || (column == Author)) {
+        const QVector<QString>& keys = (column == Title) ? m_title : m_author;
+        std::stable_sort(rows->begin(), rows->end(),
+            [&keys](qint64 a, qint64 b) {
+                return keys[a] < keys[b];
+            });
+    } else {
+        const QVector<qint64>& keys = numbers(column);
+        std::stable_sort(rows->begin(), rows->end(),
+            [&keys](qint64 a, qint64 b) {
+                return keys[a] > keys[b];
+            });
+    }
+}
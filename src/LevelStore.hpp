@@ -0,0 +1,75 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SRC_LEVELSTORE_HPP_
+#define SRC_LEVELSTORE_HPP_
+
+#include <QString>
+#include <QVector>
+#include "Data.hpp"
+
+/**
+ * @class LevelStore
+ * @brief The list metadata kept one column per field for sorting.
+ *
+ * A level is a row number into the columns. The keys are prepared once
+ * when the level is added, titles and authors are case folded and the
+ * release date is a day number, so sorting compares plain values and
+ * only moves row numbers around.
+ */
+class LevelStore {
+ public:
+    enum Column {
+        Title,
+        Author,
+        Type,
+        Class,
+        Difficulty,
+        Duration,
+        ReleaseDate
+    };
+
+    /**
+     * @brief Add a level.
+     * @return The row of the level.
+     */
+    qint64 append(const ListItemData& item);
+    void clear();
+    qint64 size() const;
+
+    /**
+     * @brief Sort rows by a column.
+     *
+     * Titles and authors sort A to Z, the other columns highest first.
+     * Equal keys keep their order.
+     */
+    void sort(Column column, QVector<qint64>* rows) const;
+    /**
+     * @brief True for the columns that sort highest first.
+     */
+    static bool descending(Column column);
+
+ private:
+    const QVector<qint64>& numbers(Column column) const;
+
+    QVector<qint64> m_id;
+    QVector<QString> m_title;       // Case folded
+    QVector<QString> m_author;      // Case folded
+    QVector<qint64> m_type;
+    QVector<qint64> m_class;
+    QVector<qint64> m_difficulty;
+    QVector<qint64> m_duration;
+    QVector<qint64> m_releaseDay;   // Julian day, 0 when unknown
+};
+
+#endif  // SRC_LEVELSTORE_HPP_
@@ -0,0 +1,409 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "Md5Lanes.hpp"
+#include <algorithm>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MD5_X86 1
+#endif
+
+/*
+ * RFC 1321 rounds written once for scalar and vector code, the OP_ macros
+ * are defined for each instruction set right before they are expanded.
+ */
+#define MD5_F(x, y, z) OP_XOR(z, OP_AND(x, OP_XOR(y, z)))
+#define MD5_G(x, y, z) OP_XOR(y, OP_AND(z, OP_XOR(x, y)))
+#define MD5_H(x, y, z) OP_XOR(x, OP_XOR(y, z))
+#define MD5_I(x, y, z) OP_XOR(y, OP_OR(x, OP_NOT(z)))
+#define MD5_STEP(f, a, b, c, d, w, k, s) \
+    a = OP_ADD(a, OP_ADD(f(b, c, d), OP_ADD(OP_W(w), OP_K(k)))); \
+    a = OP_ADD(OP_ROTL(a, s), b)
+#define MD5_ROUNDS \
+    MD5_STEP(MD5_F, a, b, c, d, 0, 0xd76aa478, 7); \
+    MD5_STEP(MD5_F, d, a, b, c, 1, 0xe8c7b756, 12); \
+    MD5_STEP(MD5_F, c, d, a, b, 2, 0x242070db, 17); \
+    MD5_STEP(MD5_F, b, c, d, a, 3, 0xc1bdceee, 22); \
+    MD5_STEP(MD5_F, a, b, c, d, 4, 0xf57c0faf, 7); \
+    MD5_STEP(MD5_F, d, a, b, c, 5, 0x4787c62a, 12); \
+    MD5_STEP(MD5_F, c, d, a, b, 6, 0xa8304613, 17); \
+    MD5_STEP(MD5_F, b, c, d, a, 7, 0xfd469501, 22); \
+    MD5_STEP(MD5_F, a, b, c, d, 8, 0x698098d8, 7); \
+    MD5_STEP(MD5_F, d, a, b, c, 9, 0x8b44f7af, 12); \
+    MD5_STEP(MD5_F, c, d, a, b, 10, 0xffff5bb1, 17); \
+    MD5_STEP(MD5_F, b, c, d, a, 11, 0x895cd7be, 22); \
+    MD5_STEP(MD5_F, a, b, c, d, 12, 0x6b901122, 7); \
+    MD5_STEP(MD5_F, d, a, b, c, 13, 0xfd987193, 12); \
+    MD5_STEP(MD5_F, c, d, a, b, 14, 0xa679438e, 17); \
+    MD5_STEP(MD5_F, b, c, d, a, 15, 0x49b40821, 22); \
+    MD5_STEP(MD5_G, a, b, c, d, 1, 0xf61e2562, 5); \
+    MD5_STEP(MD5_G, d, a, b, c, 6, 0xc040b340, 9); \
+    MD5_STEP(MD5_G, c, d, a, b, 11, 0x265e5a51, 14); \
+    MD5_STEP(MD5_G, b, c, d, a, 0, 0xe9b6c7aa, 20); \
+    MD5_STEP(MD5_G, a, b, c, d, 5, 0xd62f105d, 5); \
+    MD5_STEP(MD5_G, d, a, b, c, 10, 0x02441453, 9); \
+    MD5_STEP(MD5_G, c, d, a, b, 15, 0xd8a1e681, 14); \
+    MD5_STEP(MD5_G, b, c, d, a, 4, 0xe7d3fbc8, 20); \
+    MD5_STEP(MD5_G, a, b, c, d, 9, 0x21e1cde6, 5); \
+    MD5_STEP(MD5_G, d, a, b, c, 14, 0xc33707d6, 9); \
+    MD5_STEP(MD5_G, c, d, a, b, 3, 0xf4d50d87, 14); \
+    MD5_STEP(MD5_G, b, c, d, a, 8, 0x455a14ed, 20); \
+    MD5_STEP(MD5_G, a, b, c, d, 13, 0xa9e3e905, 5); \
+    MD5_STEP(MD5_G, d, a, b, c, 2, 0xfcefa3f8, 9); \
+    MD5_STEP(MD5_G, c, d, a, b, 7, 0x676f02d9, 14); \
+    MD5_STEP(MD5_G, b, c, d, a, 12, 0x8d2a4c8a, 20); \
+    MD5_STEP(MD5_H, a, b, c, d, 5, 0xfffa3942, 4); \
+    MD5_STEP(MD5_H, d, a, b, c, 8, 0x8771f681, 11); \
+    MD5_STEP(MD5_H, c, d, a, b, 11, 0x6d9d6122, 16); \
+    MD5_STEP(MD5_H, b, c, d, a, 14, 0xfde5380c, 23); \
+    MD5_STEP(MD5_H, a, b, c, d, 1, 0xa4beea44, 4); \
+    MD5_STEP(MD5_H, d, a, b, c, 4, 0x4bdecfa9, 11); \
+    MD5_STEP(MD5_H, c, d, a, b, 7, 0xf6bb4b60, 16); \
+    MD5_STEP(MD5_H, b, c, d, a, 10, 0xbebfbc70, 23); \
+    MD5_STEP(MD5_H, a, b, c, d, 13, 0x289b7ec6, 4); \
+    MD5_STEP(MD5_H, d, a, b, c, 0, 0xeaa127fa, 11); \
+    MD5_STEP(MD5_H, c, d, a, b, 3, 0xd4ef3085, 16); \
+    MD5_STEP(MD5_H, b, c, d, a, 6, 0x04881d05, 23); \
+    MD5_STEP(MD5_H, a, b, c, d, 9, 0xd9d4d039, 4); \
+    MD5_STEP(MD5_H, d, a, b, c, 12, 0xe6db99e5, 11); \
+    MD5_STEP(MD5_H, c, d, a, b, 15, 0x1fa27cf8, 16); \
+    MD5_STEP(MD5_H, b, c, d, a, 2, 0xc4ac5665, 23); \
+    MD5_STEP(MD5_I, a, b, c, d, 0, 0xf4292244, 6); \
+    MD5_STEP(MD5_I, d, a, b, c, 7, 0x432aff97, 10); \
+    MD5_STEP(MD5_I, c, d, a, b, 14, 0xab9423a7, 15); \
+    MD5_STEP(MD5_I, b, c, d, a, 5, 0xfc93a039, 21); \
+    MD5_STEP(MD5_I, a, b, c, d, 12, 0x655b59c3, 6); \
+    MD5_STEP(MD5_I, d, a, b, c, 3, 0x8f0ccc92, 10); \
+    MD5_STEP(MD5_I, c, d, a, b, 10, 0xffeff47d, 15); \
+    MD5_STEP(MD5_I, b, c, d, a, 1, 0x85845dd1, 21); \
+    MD5_STEP(MD5_I, a, b, c, d, 8, 0x6fa87e4f, 6); \
+    MD5_STEP(MD5_I, d, a, b, c, 15, 0xfe2ce6e0, 10); \
+    MD5_STEP(MD5_I, c, d, a, b, 6, 0xa3014314, 15); \
+    MD5_STEP(MD5_I, b, c, d, a, 13, 0x4e0811a1, 21); \
+    MD5_STEP(MD5_I, a, b, c, d, 4, 0xf7537e82, 6); \
+    MD5_STEP(MD5_I, d, a, b, c, 11, 0xbd3af235, 10); \
+    MD5_STEP(MD5_I, c, d, a, b, 2, 0x2ad7d2bb, 15); \
+    MD5_STEP(MD5_I, b, c, d, a, 9, 0xeb86d391, 21);
+
+static inline uint32_t load32(const unsigned char* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) |
+        (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static void compress(uint32_t* state, const unsigned char* block) {
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++) {
+        w[i] = load32(block + (4 * i));
+    }
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+
+#define OP_ADD(x, y) ((x) + (y))
+#define OP_XOR(x, y) ((x) ^ (y))
+#define OP_AND(x, y) ((x) & (y))
+#define OP_OR(x, y) ((x) | (y))
+#define OP_NOT(x) (~(x))
+#define OP_ROTL(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
+#define OP_W(i) w[i]
+#define OP_K(k) uint32_t(k)
+    MD5_ROUNDS
+#undef OP_ADD
+#undef OP_XOR
+#undef OP_AND
+#undef OP_OR
+#undef OP_NOT
+#undef OP_ROTL
+#undef OP_W
+#undef OP_K
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+static void initialize(uint32_t* state) {
+    state[0] = 0x67452301;
+    state[1] = 0xefcdab89;
+    state[2] = 0x98badcfe;
+    state[3] = 0x10325476;
+}
+
+// Hash what is left after the full blocks, with the padding and length
+static Md5Digest finish(uint32_t* state, const unsigned char* tail,
+        size_t tailSize, uint64_t size) {
+    unsigned char buffer[128];
+    (void)memset(buffer, 0, sizeof(buffer));
+    if (tailSize > 0) {
+        (void)memcpy(buffer, tail, tailSize);
+    }
+    buffer[tailSize] = 0x80;
+    const size_t blocks = (tailSize + 9 <= 64) ? 1 : 2;
+    const uint64_t bits = size * 8;
+    for (int i = 0; i < 8; i++) {
+        buffer[(blocks * 64) - 8 + i] = static_cast<unsigned char>(
+            bits >> (8 * i));
+    }
+    for (size_t i = 0; i < blocks; i++) {
+        compress(state, buffer + (64 * i));
+    }
+
+    Md5Digest digest;
+    for (int i = 0; i < 16; i++) {
+        digest[i] = static_cast<unsigned char>(state[i / 4] >> (8 * (i % 4)));
+    }
+    return digest;
+}
+
+Md5Digest md5(const unsigned char* data, size_t size) {
+    uint32_t state[4];
+    initialize(state);
+    size_t offset = 0;
+    for (; offset + 64 <= size; offset += 64) {
+        compress(state, data + offset);
+    }
+    return finish(state, data + offset, size - offset, size);
+}
+
+#ifdef MD5_X86
+/*
+ * One block for each lane, state[word][lane] keeps the lanes apart so
+ * a word of all lanes is loaded as one vector.
+ */
+__attribute__((target("sse2")))
+static void compressSse2(
+        uint32_t (*state)[8], const unsigned char* const* blocks) {
+    __m128i w[16];
+    for (int i = 0; i < 16; i++) {
+        w[i] = _mm_setr_epi32(
+            int32_t(load32(blocks[0] + (4 * i))),
+            int32_t(load32(blocks[1] + (4 * i))),
+            int32_t(load32(blocks[2] + (4 * i))),
+            int32_t(load32(blocks[3] + (4 * i))));
+    }
+    const __m128i ones = _mm_set1_epi32(-1);
+    __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i*>(state[0]));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i*>(state[1]));
+    __m128i c = _mm_loadu_si128(reinterpret_cast<__m128i*>(state[2]));
+    __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i*>(state[3]));
+    const __m128i aa = a;
+    const __m128i bb = b;
+    const __m128i cc = c;
+    const __m128i dd = d;
+
+#define OP_ADD(x, y) _mm_add_epi32(x, y)
+#define OP_XOR(x, y) _mm_xor_si128(x, y)
+#define OP_AND(x, y) _mm_and_si128(x, y)
+#define OP_OR(x, y) _mm_or_si128(x, y)
+#define OP_NOT(x) _mm_xor_si128(x, ones)
+#define OP_ROTL(x, s) _mm_or_si128(_mm_slli_epi32(x, s), \
+    _mm_srli_epi32(x, 32 - (s)))
+#define OP_W(i) w[i]
+#define OP_K(k) _mm_set1_epi32(int32_t(uint32_t(k)))
+    MD5_ROUNDS
+#undef OP_ADD
+#undef OP_XOR
+#undef OP_AND
+#undef OP_OR
+#undef OP_NOT
+#undef OP_ROTL
+#undef OP_W
+#undef OP_K
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state[0]),
+        _mm_add_epi32(a, aa));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state[1]),
+        _mm_add_epi32(b, bb));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state[2]),
+        _mm_add_epi32(c, cc));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state[3]),
+        _mm_add_epi32(d, dd));
+}
+
+__attribute__((target("avx2")))
+static void compressAvx2(
+        uint32_t (*state)[8], const unsigned char* const* blocks) {
+    __m256i w[16];
+    for (int i = 0; i < 16; i++) {
+        w[i] = _mm256_setr_epi32(
+            int32_t(load32(blocks[0] + (4 * i))),
+            int32_t(load32(blocks[1] + (4 * i))),
+            int32_t(load32(blocks[2] + (4 * i))),
+            int32_t(load32(blocks[3] + (4 * i))),
+            int32_t(load32(blocks[4] + (4 * i))),
+            int32_t(load32(blocks[5] + (4 * i))),
+            int32_t(load32(blocks[6] + (4 * i))),
+            int32_t(load32(blocks[7] + (4 * i))));
+    }
+    const __m256i ones = _mm256_set1_epi32(-1);
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i*>(state[0]));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i*>(state[1]));
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<__m256i*>(state[2]));
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i*>(state[3]));
+    const __m256i aa = a;
+    const __m256i bb = b;
+    const __m256i cc = c;
+    const __m256i dd = d;
+
+#define OP_ADD(x, y) _mm256_add_epi32(x, y)
+#define OP_XOR(x, y) _mm256_xor_si256(x, y)
+#define OP_AND(x, y) _mm256_and_si256(x, y)
+#define OP_OR(x, y) _mm256_or_si256(x, y)
+#define OP_NOT(x) _mm256_xor_si256(x, ones)
+#define OP_ROTL(x, s) _mm256_or_si256(_mm256_slli_epi32(x, s), \
+    _mm256_srli_epi32(x, 32 - (s)))
+#define OP_W(i) w[i]
+#define OP_K(k) _mm256_set1_epi32(int32_t(uint32_t(k)))
+    MD5_ROUNDS
+#undef OP_ADD
+#undef OP_XOR
+#undef OP_AND
+#undef OP_OR
+#undef OP_NOT
+#undef OP_ROTL
+#undef OP_W
+#undef OP_K
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[0]),
+        _mm256_add_epi32(a, aa));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[1]),
+        _mm256_add_epi32(b, bb));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[2]),
+        _mm256_add_epi32(c, cc));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(state[3]),
+        _mm256_add_epi32(d, dd));
+}
+#endif  // MD5_X86
+
+int md5Lanes() {
+#ifdef MD5_X86
+    static const int lanes = (__builtin_cpu_supports("avx2") != 0) ? 8 :
+        ((__builtin_cpu_supports("sse2") != 0) ? 4 : 1);
+    return lanes;
+#else
+    return 1;
+#endif
+}
+
+void md5Batch(const Md5Input* inputs, size_t count, Md5Digest* digests,
+        int lanes) {
+    const int supported = md5Lanes();
+    if ((lanes <= 0) || (lanes > supported)) {
+        lanes = supported;
+    }
+    lanes = (lanes >= 8) ? 8 : ((lanes >= 4) ? 4 : 1);
+
+#ifdef MD5_X86
+    static const unsigned char idle[64] = {};
+    uint32_t state[4][8];
+    const unsigned char* blocks[8];
+    size_t current[8];
+    size_t offset[8];
+    bool active[8] = {};
+    size_t next = 0;
+
+    while (lanes > 1) {
+        // Give every idle lane the next buffer with at least one full block
+        int busy = 0;
+        for (int lane = 0; lane < lanes; lane++) {
+            while ((active[lane] == false) && (next < count)) {
+                const size_t i = next++;
+                if (inputs[i].size < 64) {
+                    digests[i] = md5(inputs[i].data, inputs[i].size);
+                } else {
+                    uint32_t column[4];
+                    initialize(column);
+                    for (int word = 0; word < 4; word++) {
+                        state[word][lane] = column[word];
+                    }
+                    current[lane] = i;
+                    offset[lane] = 0;
+                    active[lane] = true;
+                }
+            }
+            if (active[lane] == true) {
+                busy++;
+            }
+        }
+        if (busy <= 1) {
+            break;
+        }
+
+        // Run in lock-step until the first lane runs out of full blocks
+        size_t steps = SIZE_MAX;
+        for (int lane = 0; lane < lanes; lane++) {
+            if (active[lane] == true) {
+                steps = std::min(steps,
+                    (inputs[current[lane]].size - offset[lane]) / 64);
+            }
+        }
+        for (size_t step = 0; step < steps; step++) {
+            for (int lane = 0; lane < lanes; lane++) {
+                blocks[lane] = (active[lane] == true) ?
+                    inputs[current[lane]].data + offset[lane] : idle;
+            }
+            if (lanes == 8) {
+                compressAvx2(state, blocks);
+            } else {
+                compressSse2(state, blocks);
+            }
+            for (int lane = 0; lane < lanes; lane++) {
+                if (active[lane] == true) {
+                    offset[lane] += 64;
+                }
+            }
+        }
+
+        for (int lane = 0; lane < lanes; lane++) {
+            if ((active[lane] == true) &&
+                    (inputs[current[lane]].size - offset[lane] < 64)) {
+                const Md5Input& input = inputs[current[lane]];
+                uint32_t column[4];
+                for (int word = 0; word < 4; word++) {
+                    column[word] = state[word][lane];
+                }
+                digests[current[lane]] = finish(column,
+                    input.data + offset[lane], input.size - offset[lane],
+                    input.size);
+                active[lane] = false;
+            }
+        }
+    }
+
+    // The last buffer standing is finished without the other lanes
+    for (int lane = 0; lane < lanes; lane++) {
+        if (active[lane] == true) {
+            const Md5Input& input = inputs[current[lane]];
+            uint32_t column[4];
+            for (int word = 0; word < 4; word++) {
+                column[word] = state[word][lane];
+            }
+            size_t at = offset[lane];
+            for (; at + 64 <= input.size; at += 64) {
+                compress(column, input.data + at);
+            }
+            digests[current[lane]] = finish(column,
+                input.data + at, input.size - at, input.size);
+        }
+    }
+#endif  // MD5_X86
+
+    if (lanes == 1) {
+        for (size_t i = 0; i < count; i++) {
+            digests[i] = md5(inputs[i].data, inputs[i].size);
+        }
+    }
+}
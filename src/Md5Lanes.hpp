@@ -0,0 +1,59 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SRC_MD5LANES_HPP_
+#define SRC_MD5LANES_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @struct Md5Input
+ * @brief A buffer to hash, usually a mapped file.
+ */
+struct Md5Input {
+    const unsigned char* data;
+    size_t size;
+};
+
+using Md5Digest = std::array<unsigned char, 16>;
+
+/**
+ * @brief Number of buffers hashed side by side on this CPU.
+ * @return 8 with AVX2, 4 with SSE2 and 1 elsewhere.
+ */
+int md5Lanes();
+
+/**
+ * @brief MD5 of one buffer.
+ */
+Md5Digest md5(const unsigned char* data, size_t size);
+
+/**
+ * @brief MD5 of many buffers, hashed in lock-step in SIMD lanes.
+ *
+ * Each lane works on its own buffer one 64 byte block at a time and takes
+ * the next buffer when it is done, so buffers of different sizes mix
+ * well. The last blocks of a buffer and the padding are hashed one lane
+ * at a time.
+ *
+ * @param[in] inputs The buffers.
+ * @param[in] count Number of buffers.
+ * @param[out] digests One digest for each buffer.
+ * @param[in] lanes Lanes to use, 0 for md5Lanes(), mainly for tests.
+ */
+void md5Batch(const Md5Input* inputs, size_t count, Md5Digest* digests,
+    int lanes = 0);
+
+#endif  // SRC_MD5LANES_HPP_
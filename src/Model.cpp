@@ -12,6 +12,10 @@
  */
 
 #include "Model.hpp"
+#include <QSettings>
+#include <algorithm>
+#include "ZipStream.hpp"
+#include "snapshot.hpp"
 
 // Those lambda should be in another header file
 // I hate this and it should be able to recognize both the directory
@@ -35,7 +39,12 @@ bool Model::setDirectory(const QString& level, const QString& game) {
     bool status = false;
     if (fileManager.setUpCamp(level, game) &&
             downloader.setUpCamp(level) &&
+            thumbnailCache.setUpCamp(level) &&
+            fileHashCache.setUpCamp(level) &&
+            objectStore.setUpCamp(level,
+                QSettings().value("shareLevelFiles", true).toBool()) &&
             data.initializeDatabase(level)) {
+        m_levelPath = level;
         status = true;
     }
     return status;
@@ -59,6 +68,9 @@ void Model::setup(const QString& level, const QString& game) {
         }
         emit generateListSignal(commonFiles);
         QCoreApplication::processEvents();
+        loadList(commonFiles);
+        // After the list so it is not held up by a rebuild
+        (void)data.updateSearchIndex();
     } else {
         // send signal to gui with error about setup fail
         qDebug() << "setDirectory setup failed";
@@ -103,8 +115,87 @@ int Model::checkGameDirectory(int id) {
     return status;
 }
 
-void Model::getList(QVector<ListItemData>* list) {
-    *list = data.getListItems();
+void Model::sendList(const QVector<ListItemData>& list) {
+    for (qint64 i = 0; i < list.size(); i += 32) {
+        emit listBatchSignal(list.mid(i, 32));
+    }
+}
+
+void Model::loadList(const QList<int>& availableGames) {
+    const QString snapshotPath = QString("%1/%2").arg(m_levelPath, ".list");
+    const QFileInfo database(QString("%1/%2").arg(m_levelPath, "tombll.db"));
+
+    // Show the list from the last run first, the view loads the covers
+    // from the thumbnail cache when they are shown
+    QVector<ListItemData> snapshot;
+    bool upToDate = false;
+    const bool shown =
+        readListSnapshot(snapshotPath, database, &snapshot, &upToDate);
+    if (shown == true) {
+        sendList(snapshot);
+        emit listDoneSignal();
+        QCoreApplication::processEvents();
+    }
+
+    if (upToDate == false) {
+        // Rows are read here on the controller thread, each batch of covers
+        // is decoded into the thumbnail cache on the pool and sent to the
+        // GUI as soon as it is done. Pixels only travel with an item when
+        // its card could not be cached.
+        QVector<ListItemData> built;
+        QMutex mutex;
+        data.getListItems(32,
+                [this, shown, &built, &mutex](
+                    const QVector<ListItemData>& batch) {
+            m_decodePool.start(QRunnable::create(
+                    [this, shown, batch, &built, &mutex]() {
+                QVector<ListItemData> list = batch;
+                for (ListItemData& item : list) {
+                    item.decodePicture();
+                    if (thumbnailCache.hasImage(item.m_pictureId,
+                            item.m_pictureHash,
+                            ListItemData::coverSize()) == true) {
+                        item.m_picture = QImage();
+                    }
+                }
+                if (shown == false) {
+                    emit listBatchSignal(list);
+                }
+                QMutexLocker locker(&mutex);
+                for (ListItemData item : list) {
+                    item.m_picture = QImage();
+                    built.append(item);
+                }
+            }));
+        });
+        m_decodePool.waitForDone();
+
+        std::sort(built.begin(), built.end(),
+            [](const ListItemData& a, const ListItemData& b) {
+                return a.m_id < b.m_id;
+            });
+
+        if ((shown == true) && (sameListItems(snapshot, built) == false)) {
+            // The database changed since the snapshot
+            emit generateListSignal(availableGames);
+            sendList(built);
+        }
+        // Also when only covers were missing, they are in the cache now
+        emit listDoneSignal();
+        (void)writeListSnapshot(snapshotPath, database, built);
+
+        // Cards of levels or pictures no longer in the database, an empty
+        // list is more likely a failed query
+        QSet<qint64> pictureIds;
+        for (const ListItemData& item : qAsConst(built)) {
+            pictureIds.insert(item.m_pictureId);
+        }
+        const qint64 removed = (built.isEmpty() == true) ? 0 :
+            thumbnailCache.prune(pictureIds, ListItemData::coverSize());
+        if (removed > 0) {
+            qDebug() << "Removed" << removed << "unused cards";
+        }
+    }
 }
 
 int Model::getItemState(int id) {
@@ -126,14 +217,16 @@ int Model::getItemState(int id) {
 
 bool Model::runWine(const int id) {
     bool status = true;
+    QString exe;
     if (id < 0) {  // we use original game id as negative number
         int orgId = (-1)*id;
         const QString s = QString("/Original.TR%1").arg(orgId);
-        m_wineRunner.setWorkingDirectory(fileManager.getExtraPath(s));
+        m_wineRunner.setWorkingDirectory(fileManager.getExtraPath(s, &exe));
     } else {
         const QString s = QString("/%1.TRLE").arg(id);
-        m_wineRunner.setWorkingDirectory(fileManager.getExtraPath(s));
+        m_wineRunner.setWorkingDirectory(fileManager.getExtraPath(s, &exe));
     }
+    m_wineRunner.setProgram(exe.isEmpty() ? "tomb4.exe" : exe);
     m_wineRunner.run();
     return status;
 }
@@ -169,22 +262,20 @@ void Model::setupGame(int id) {
     const QString levelPath = QString("/Original.TR%1/").arg(id);
     const QString gamePath = QString("/%1/").arg(getGameDirectory(id));
 
-    for (size_t i = 0; i < s; i++) {
-        const QString levelFile = QString("%1%2").arg(levelPath, list[i].path);
-        const QString gameFile = QString("%1%2").arg(gamePath, list[i].path);
-        const QString calculated = fileManager.calculateMD5(gameFile, true);
-
-        if (list[i].md5sum == calculated) {
-            (void)fileManager.copyFile(gameFile, levelFile,  true);
-        } else {
-            qDebug() << "Original file was modified, had" << list[i].md5sum
-                     << " got " << calculated << " for file "
-                     << list[i].path << Qt::endl;
+    // The last tick is sent when the game directory is linked. The level
+    // and sound files are hard linked to the originals that are kept as
+    // the backup, when both are on the same file system.
+    // A directory that was there before may hold the only originals, for
+    // when the game directory already links into it
+    const bool existed = fileManager.checkDir(levelPath, false);
+    QString failed;
+    if (fileManager.copyVerifiedFiles(
+            list, gamePath, levelPath, 99, &failed, true) == false) {
+        qDebug() << "Setup of game" << id << "stopped at" << failed;
+        if (existed == false) {
             (void)fileManager.cleanWorkingDir(levelPath);
-            break;
         }
-    }
-    if (fileManager.backupGameDir(gamePath)) {
+    } else if (fileManager.backupGameDir(gamePath)) {
         // remove the ending '/' and instantly link to
         // the game directory link to new game directory
         const QString src = levelPath.chopped(1);
@@ -193,37 +284,59 @@ void Model::setupGame(int id) {
             qDebug() << "Faild to create the link to the new game directory";
         }
     }
-    for (int i=0; i < 100; i++) {
-        emit this->modelTickSignal();
-        QCoreApplication::processEvents();
-    }
+    (void)fileHashCache.save();
+    emit this->modelTickSignal();
 }
 
 bool Model::unpackLevel(const int id, const QString& name) {
     bool status = false;
     const QString directory = QString("%1.TRLE").arg(id);
-    if (fileManager.extractZip(name, directory) == true) {
+    // Over an earlier install only what changed is written again, files
+    // that are not in the archive like saved games are kept
+    const bool repair = fileManager.checkDir(directory, false);
+    if (fileManager.extractZip(name, directory, repair, false) == true) {
         instructionManager.executeInstruction(id);
         status = true;
     }
     return status;
 }
 
-bool Model::getLevelHaveFile(
-        const int id, const QString& md5sum, const QString& name) {
+bool Model::downloadLevel(const int id, const QString& md5sum,
+        const QString& name, bool* unpacked) {
+    bool status = false;
+    const QString directory = QString("%1.TRLE").arg(id);
+    QCryptographicHash md5(QCryptographicHash::Md5);
+    ZipStream stream(QString("%1/%2").arg(m_levelPath, directory));
+
+    // The zip is hashed and unpacked while it arrives. It is still saved,
+    // if it can not be unpacked front to back it is extracted from disk.
+    downloader.setSink([&md5, &stream](const char* chunk, qint64 size) {
+        md5.addData(chunk, size);
+        (void)stream.feed(chunk, size);
+    });
+    downloader.run();
+    downloader.setSink(nullptr);
+
+    if (downloader.getStatus() == 0) {
+        const QString downloadedSum = QString(md5.result().toHex());
+        fileHashCache.insert(
+            QString("%1/%2").arg(m_levelPath, name), downloadedSum);
+        if (downloadedSum != md5sum) {
+            data.setDownloadMd5(id, downloadedSum);
+        }
+        *unpacked = stream.finish();
+        status = true;
+    }
+    return status;
+}
+
+bool Model::getLevelHaveFile(const int id, const QString& md5sum,
+        const QString& name, bool* unpacked) {
     bool status = false;
     if (md5sum != "") {
         const QString existingFilesum = fileManager.calculateMD5(name, false);
         if (existingFilesum != md5sum) {
-            downloader.run();
-            if (downloader.getStatus() == 0) {
-                const QString downloadedSum =
-                    fileManager.calculateMD5(name, false);
-                if (downloadedSum != md5sum) {
-                    data.setDownloadMd5(id, downloadedSum);
-                }
-                status = true;
-            }
+            status = downloadLevel(id, md5sum, name, unpacked);
         } else {
             // send 50% signal for skipped downloading ticks
             for (int i=0; i < 50; i++) {
@@ -236,40 +349,47 @@ bool Model::getLevelHaveFile(
     return status;
 }
 
-bool Model::getLevelDontHaveFile(
-        const int id, const QString& md5sum, const QString& name) {
-    bool status = false;
-    downloader.run();
-    if (!downloader.getStatus()) {
-        const QString downloadedSum = fileManager.calculateMD5(name, false);
-        if (downloadedSum != md5sum) {
-            data.setDownloadMd5(id, downloadedSum);
-        }
-        status = true;
-    }
-    return status;
+bool Model::getLevelDontHaveFile(const int id, const QString& md5sum,
+        const QString& name, bool* unpacked) {
+    return downloadLevel(id, md5sum, name, unpacked);
 }
 
 void Model::getLevel(int id) {
     assert(id > 0);
     if (id > 0) {
         bool status = false;
+        bool unpacked = false;
         ZipData zipData = data.getDownload(id);
         downloader.setUrl(zipData.url);
         downloader.setSaveFile(zipData.name);
         // this if just slips up execution but has nothing to do with the error
         if (fileManager.checkFile(zipData.name, false)) {
             qWarning() << "File exists:" << zipData.name;
-            status = getLevelHaveFile(id, zipData.md5sum, zipData.name);
+            status = getLevelHaveFile(
+                id, zipData.md5sum, zipData.name, &unpacked);
         } else {
             qDebug() << "File does not exist:" << zipData.name;
-            status = getLevelDontHaveFile(id, zipData.md5sum, zipData.name);
+            status = getLevelDontHaveFile(
+                id, zipData.md5sum, zipData.name, &unpacked);
         }
-        if (status == true) {
+        if ((status == true) && (unpacked == true)) {
+            instructionManager.executeInstruction(id);
+            // send 50% signal for the unpacking done while downloading
+            for (int i=0; i < 50; i++) {
+                emit this->modelTickSignal();
+            }
+        } else if (status == true) {
             if (!unpackLevel(id, zipData.name)) {
                 qDebug() << "unpackLevel failed";
+                status = false;
             }
         }
+        if (status == true) {
+            // Find the game root now so launching only checks it
+            (void)fileManager.getExtraPath(QString("/%1.TRLE").arg(id));
+        }
+        (void)fileHashCache.save();
+        (void)objectStore.save();
     }
 }
 
@@ -280,3 +400,7 @@ const InfoData Model::getInfo(int id) {
 const QString Model::getWalkthrough(int id) {
     return data.getWalkthrough(id);
 }
+
+QVector<qint64> Model::searchLevels(const QString& text, int field) {
+    return data.searchLevels(text, field);
+}
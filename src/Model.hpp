@@ -21,9 +21,12 @@
 #include <QtCore>
 #include <cassert>
 #include "Data.hpp"
+#include "FileHashCache.hpp"
 #include "FileManager.hpp"
 #include "Network.hpp"
+#include "ObjectStore.hpp"
 #include "Runner.hpp"
+#include "ThumbnailCache.hpp"
 
 class InstructionManager : public QObject {
     Q_OBJECT
@@ -60,7 +63,7 @@ class Model : public QObject {
     void checkCommonFiles(QList<int>* games);
     int checkGameDirectory(int id);
     int checkLevelDirectory(int id);
-    void getList(QVector<ListItemData>* list);
+    void loadList(const QList<int>& availableGames);
     int getItemState(int id);
     bool runWine(const int id);
     bool setLink(int id);
@@ -69,25 +72,36 @@ class Model : public QObject {
     void getLevel(int id);
     const InfoData getInfo(int id);
     const QString getWalkthrough(int id);
+    QVector<qint64> searchLevels(const QString& text, int field);
     bool setDirectory(const QString& level, const QString& game);
     void setup(const QString& level, const QString& game);
 
  signals:
     void generateListSignal(QList<int> availableGames);
+    void listBatchSignal(QVector<ListItemData> list);
+    void listDoneSignal();
     void modelTickSignal();
 
  private:
-    bool getLevelHaveFile(
-        const int id, const QString& md5sum, const QString& name);
-    bool getLevelDontHaveFile(
-        const int id, const QString& md5sum, const QString& name);
+    bool downloadLevel(const int id, const QString& md5sum,
+        const QString& name, bool* unpacked);
+    bool getLevelHaveFile(const int id, const QString& md5sum,
+        const QString& name, bool* unpacked);
+    bool getLevelDontHaveFile(const int id, const QString& md5sum,
+        const QString& name, bool* unpacked);
     bool unpackLevel(const int id, const QString& name);
+    void sendList(const QVector<ListItemData>& list);
 
     Runner m_wineRunner = Runner("/usr/bin/wine");
     Data& data = Data::getInstance();
     FileManager& fileManager = FileManager::getInstance();
     Downloader& downloader = Downloader::getInstance();
+    ThumbnailCache& thumbnailCache = ThumbnailCache::getInstance();
+    FileHashCache& fileHashCache = FileHashCache::getInstance();
+    ObjectStore& objectStore = ObjectStore::getInstance();
     InstructionManager instructionManager;
+    QThreadPool m_decodePool;
+    QString m_levelPath;
 
     Model();
     ~Model();
@@ -96,6 +96,11 @@ void Downloader::setSaveFile(const QString& file) {
     m_file = file;
 }
 
+void Downloader::setSink(
+        const std::function<void(const char*, qint64)>& sink) {
+    m_sink = sink;
+}
+
 int Downloader::getStatus() {
     return m_status;
 }
@@ -165,6 +170,11 @@ void Downloader::connect(QFile *file, const char* url_cstring) {
                         writtenSize = file->write(static_cast<const char*>(buf),
                                 size * nmemb);
                     }
+                    Downloader& downloader = Downloader::getInstance();
+                    if ((writtenSize > 0) && downloader.m_sink) {
+                        downloader.m_sink(
+                            static_cast<const char*>(buf), writtenSize);
+                    }
                     // cppcheck-suppress misra-c2012-15.5
                     return writtenSize;
                 });
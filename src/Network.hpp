@@ -21,6 +21,7 @@
 #include <QtCore>
 #include <QDebug>
 #include <curl/curl.h>
+#include <functional>
 
 class Downloader : public QObject {
     Q_OBJECT
@@ -37,6 +38,13 @@ class Downloader : public QObject {
     void setUrl(QUrl url);
     int getStatus();
     void setSaveFile(const QString& file);
+    /**
+     * @brief Also pass every downloaded chunk to a function.
+     *
+     * Called on the downloading thread after the chunk is written to the
+     * save file. Set an empty function to stop.
+     */
+    void setSink(const std::function<void(const char*, qint64)>& sink);
 
  signals:
     void networkWorkTickSignal();
@@ -50,6 +58,7 @@ class Downloader : public QObject {
     QDir m_levelDir;
     qint32 m_status;
     int m_lastEmittedProgress;
+    std::function<void(const char*, qint64)> m_sink;
 
     Downloader() :
         m_url(""),
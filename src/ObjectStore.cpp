@@ -0,0 +1,268 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ObjectStore.hpp"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStringList>
+#include <QVector>
+#include <cerrno>
+#include <cstring>
+
+static constexpr quint32 OBJECTSTORE_VERSION = 1;
+
+static bool sameFile(const QByteArray& a, const QByteArray& b) {
+    struct stat infoA;
+    struct stat infoB;
+    return (::stat(a.constData(), &infoA) == 0) &&
+        (::stat(b.constData(), &infoB) == 0) &&
+        (infoA.st_dev == infoB.st_dev) && (infoA.st_ino == infoB.st_ino);
+}
+
+bool ObjectStore::setUpCamp(const QString& levelDir, bool enabled) {
+    bool status = true;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_path = QString("%1%2%3")
+            .arg(levelDir, QDir::separator(), ".objects");
+        m_index.clear();
+        m_changed = false;
+        m_enabled = false;
+
+        QDir dir(m_path);
+        if (enabled == false) {
+            qDebug() << "Shared level files are turned off";
+        } else if (!dir.exists() && !dir.mkpath(m_path)) {
+            qWarning() << "Failed to create object directory:" << m_path;
+            status = false;
+        } else {
+            m_enabled = true;
+        }
+
+        QFile file(m_path + "/index");
+        if ((m_enabled == true) && (file.open(  // flawfinder: ignore
+                QIODevice::ReadOnly) == true)) {
+            const QByteArray data = file.readAll();
+            ObjectIndexHeader header;
+            (void)memset(&header, 0, sizeof(ObjectIndexHeader));
+            if (data.size() >= qint64(sizeof(ObjectIndexHeader))) {
+                (void)memcpy(&header, data.constData(),
+                    sizeof(ObjectIndexHeader));
+            }
+            if ((strncmp(header.magic.data(), "TRLO", 4) == 0) &&
+                    (header.version == OBJECTSTORE_VERSION) &&
+                    (data.size() == qint64(sizeof(ObjectIndexHeader)) +
+                        (qint64(header.count) * sizeof(ObjectIndexRecord)))) {
+                const char* records =
+                    data.constData() + sizeof(ObjectIndexHeader);
+                for (quint32 i = 0; i < header.count; i++) {
+                    ObjectIndexRecord record;
+                    (void)memcpy(&record,
+                        records + (qint64(i) * sizeof(ObjectIndexRecord)),
+                        sizeof(ObjectIndexRecord));
+                    m_index.insert(qMakePair(record.size, record.crc),
+                        QByteArray(record.sha256.data(), 32));
+                }
+            } else {
+                qWarning() << "Ignoring invalid object index:"
+                    << file.fileName();
+            }
+        }
+    }
+
+    if (m_enabled == true) {
+        const qint64 freed = collect();
+        if (freed > 0) {
+            qDebug() << "Removed unused level files," << freed << "bytes";
+        }
+    }
+    return status;
+}
+
+bool ObjectStore::accepts(const QString& path) {
+    // Read by the games but never written, executables are left out as
+    // they can be patched for one level
+    static const QStringList suffixes = {
+        "phd", "tr2", "tr4", "trc", "sfx", "pak", "wav", "mp3", "ogg",
+        "bmp", "jpg", "png", "pcx", "tga"};
+    return suffixes.contains(QFileInfo(path).suffix().toLower());
+}
+
+QString ObjectStore::objectPath(const QByteArray& sha256) const {
+    const QString hex = QString(sha256.toHex());
+    return QString("%1/%2/%3").arg(m_path, hex.left(2), hex.mid(2));
+}
+
+ObjectStore::Match::Match(const QString& path, quint64 size, quint32 crc)
+        : m_path(path), m_size(size) {
+    ObjectStore& store = ObjectStore::getInstance();
+    if (accepts(path) == true) {
+        QMutexLocker locker(&store.m_mutex);
+        auto it = store.m_index.constFind(qMakePair(size, crc));
+        if ((store.m_enabled == true) && (it != store.m_index.constEnd())) {
+            m_object.setFileName(store.objectPath(it.value()));
+        }
+    }
+
+    const bool opened = (m_object.fileName().isEmpty() == false) &&
+        (m_object.open(QIODevice::ReadOnly) == true);  // flawfinder: ignore
+    if ((opened == true) && (quint64(m_object.size()) == size)) {
+        m_data = (size > 0) ? m_object.map(0, m_object.size()) : nullptr;
+        m_found = (size == 0) || (m_data != nullptr);
+        m_same = m_found;
+    }
+}
+
+bool ObjectStore::Match::compare(const uchar* data, qint64 size) {
+    if ((m_same == true) && (size > 0)) {
+        if ((m_matched + quint64(size) > m_size) ||
+                (memcmp(m_data + m_matched, data, size_t(size)) != 0)) {
+            m_same = false;
+        } else {
+            m_matched += size;
+        }
+    }
+    return m_same;
+}
+
+bool ObjectStore::Match::place() {
+    bool status = false;
+    if ((m_same == true) && (m_matched == m_size)) {
+        const QByteArray target = QFile::encodeName(m_path);
+        (void)::unlink(target.constData());
+        status = (::link(QFile::encodeName(m_object.fileName()).constData(),
+            target.constData()) == 0);
+    }
+    return status;
+}
+
+void ObjectStore::add(const QString& path, quint32 crc) {
+    QFile file(path);
+    if ((m_enabled == true) && (accepts(path) == true) &&
+            (file.open(QIODevice::ReadOnly) == true)) {  // flawfinder: ignore
+        QCryptographicHash sha256(QCryptographicHash::Sha256);
+        const bool hashed = sha256.addData(&file);
+        const quint64 size = quint64(file.size());
+        file.close();
+
+        const QByteArray sum = sha256.result();
+        const QString object = objectPath(sum);
+        const QByteArray source = QFile::encodeName(path);
+        const QByteArray destination = QFile::encodeName(object);
+        bool stored = false;
+
+        if ((hashed == true) &&
+                (QDir().mkpath(QFileInfo(object).path()) == true)) {
+            if (::link(source.constData(), destination.constData()) == 0) {
+                stored = true;
+            } else if (errno != EEXIST) {
+                qWarning() << "Failed to store level file:" << path;
+            } else if (sameFile(source, destination) == true) {
+                stored = true;
+            } else {
+                // Same content in another level, share that copy instead
+                const QByteArray temporary = source + ".link";
+                (void)::unlink(temporary.constData());
+                stored = (::link(destination.constData(),
+                        temporary.constData()) == 0) &&
+                    (::rename(temporary.constData(),
+                        source.constData()) == 0);
+            }
+        }
+
+        if (stored == true) {
+            QMutexLocker locker(&m_mutex);
+            m_index.insert(qMakePair(size, crc), sum);
+            m_changed = true;
+        }
+    }
+}
+
+qint64 ObjectStore::collect() {
+    qint64 freed = 0;
+    QString path;
+    {
+        QMutexLocker locker(&m_mutex);
+        path = m_path;
+    }
+
+    QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext() == true) {
+        const QString object = it.next();
+        struct stat info;
+        if ((it.fileInfo().fileName() != "index") &&
+                (::stat(QFile::encodeName(object).constData(), &info) == 0) &&
+                (info.st_nlink == 1) && (QFile::remove(object) == true)) {
+            freed += info.st_size;
+        }
+    }
+
+    if (freed > 0) {
+        QMutexLocker locker(&m_mutex);
+        for (auto it = m_index.begin(); it != m_index.end();) {
+            if (QFile::exists(objectPath(it.value())) == false) {
+                it = m_index.erase(it);
+                m_changed = true;
+            } else {
+                ++it;
+            }
+        }
+    }
+    return freed;
+}
+
+bool ObjectStore::save() {
+    QMutexLocker locker(&m_mutex);
+    bool status = true;
+    if ((m_changed == true) && (m_enabled == true)) {
+        QVector<ObjectIndexRecord> records;
+        records.reserve(m_index.size());
+        for (auto it = m_index.constBegin(); it != m_index.constEnd(); ++it) {
+            ObjectIndexRecord record;
+            record.size = it.key().first;
+            record.crc = it.key().second;
+            (void)memcpy(record.sha256.data(), it.value().constData(), 32);
+            records.append(record);
+        }
+
+        ObjectIndexHeader header;
+        (void)memcpy(header.magic.data(), "TRLO", 4);
+        header.version = OBJECTSTORE_VERSION;
+        header.count = records.size();
+
+        const qint64 recordsSize =
+            qint64(records.size()) * sizeof(ObjectIndexRecord);
+        QSaveFile file(m_path + "/index");
+        status = (file.open(  // flawfinder: ignore
+                QIODevice::WriteOnly) == true) &&
+            (file.write(reinterpret_cast<const char*>(&header),
+                sizeof(ObjectIndexHeader)) ==
+                    qint64(sizeof(ObjectIndexHeader))) &&
+            (file.write(reinterpret_cast<const char*>(records.constData()),
+                recordsSize) == recordsSize) &&
+            file.commit();
+        if (status == true) {
+            m_changed = false;
+        } else {
+            qWarning() << "Failed to write object index:" << m_path;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,145 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SRC_OBJECTSTORE_HPP_
+#define SRC_OBJECTSTORE_HPP_
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <array>
+
+#pragma pack(push, 1)  // Set 1-byte alignment
+struct ObjectIndexHeader {
+    std::array<char, 4> magic;          // Magic number ("TRLO")
+    quint32 version;                    // Bumped when the layout changes
+    quint32 count;                      // Number of records
+};
+
+struct ObjectIndexRecord {
+    quint64 size;
+    quint32 crc;                        // CRC-32 as in the zip entry
+    std::array<char, 32> sha256;        // Name of the object
+};
+#pragma pack(pop)
+
+/**
+ * @class ObjectStore
+ * @brief Level files shared between installed levels by content.
+ *
+ * Every object is a file under `.objects` in the level directory named
+ * by the SHA-256 of its content, and every installed copy is a hard link
+ * to it. The link count is the reference count, an object only linked
+ * from the store is removed by collect().
+ *
+ * Only level, sound, music and picture files are shared, the games never
+ * write to them. Saved games, settings and executables, which get
+ * patched, stay separate files in each level.
+ *
+ * An index from the zip entry size and CRC-32 finds the object an entry
+ * may be equal to. The CRC-32 is too weak to trust, so the extraction
+ * inflates the entry into a Match, which links the object only if every
+ * byte is the same, and nothing is written to disk. Safe to use from the
+ * extraction workers.
+ */
+class ObjectStore {
+ public:
+    static ObjectStore& getInstance() {
+        // cppcheck-suppress threadsafety-threadsafety
+        static ObjectStore instance;
+        return instance;
+    }
+
+    /**
+     * @brief Open the store and remove objects no level links to anymore.
+     * @param[in] enabled When false no Match is found and add() does
+     *            nothing.
+     */
+    bool setUpCamp(const QString& levelDir, bool enabled);
+    /**
+     * @brief If the file can be shared between levels.
+     */
+    static bool accepts(const QString& path);
+    /**
+     * @class Match
+     * @brief Compare an unpacked entry with the object it may be equal to.
+     *
+     * The object with the size and CRC-32 of the entry is mapped and the
+     * inflated bytes are fed to compare(). place() links the object to the
+     * path only when all of them were the same.
+     */
+    class Match {
+     public:
+        Match(const QString& path, quint64 size, quint32 crc);
+        /**
+         * @brief If there is an object to compare with.
+         */
+        bool found() const { return m_found; }
+        /**
+         * @brief Compare the next bytes of the entry.
+         * @return false once a byte differs, later calls do nothing.
+         */
+        bool compare(const uchar* data, qint64 size);
+        /**
+         * @brief Bytes that were the same before the first difference.
+         */
+        quint64 matched() const { return m_matched; }
+        /**
+         * @brief The object, to write the bytes that matched from.
+         */
+        const uchar* data() const { return m_data; }
+        /**
+         * @brief Link the object to the path if the whole entry matched.
+         */
+        bool place();
+
+     private:
+        QString m_path;
+        QFile m_object;
+        const uchar* m_data = nullptr;
+        quint64 m_size = 0;
+        quint64 m_matched = 0;
+        bool m_found = false;
+        bool m_same = false;
+        Q_DISABLE_COPY(Match)
+    };
+
+    /**
+     * @brief Store an unpacked file, or link the path to an equal object.
+     */
+    void add(const QString& path, quint32 crc);
+    /**
+     * @brief Remove objects that are only linked from the store.
+     * @return Bytes freed.
+     */
+    qint64 collect();
+    /**
+     * @brief Write the index if something was added since the last save.
+     */
+    bool save();
+
+ private:
+    ObjectStore() {}
+    QString objectPath(const QByteArray& sha256) const;
+
+    QMutex m_mutex;
+    QHash<QPair<quint64, quint32>, QByteArray> m_index;
+    QString m_path;
+    bool m_enabled = false;
+    bool m_changed = false;
+    Q_DISABLE_COPY(ObjectStore)
+};
+
+#endif  // SRC_OBJECTSTORE_HPP_
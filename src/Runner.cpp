@@ -33,9 +33,13 @@ void Runner::setWorkingDirectory(const QString& cwd) {
     m_process.setWorkingDirectory(cwd);
 }
 
+void Runner::setProgram(const QString& program) {
+    m_program = program;
+}
+
 void Runner::run() {
     // Start Wine with the application as an argument
-    m_process.start(m_command, QStringList() << "tomb4.exe");
+    m_process.start(m_command, QStringList() << m_program);
     QObject::connect(&m_process, &QProcess::readyReadStandardOutput, [&]() {
         // Read and print the output to standard output
         QTextStream(stdout) << m_process.readAllStandardOutput();
@@ -30,6 +30,7 @@ class Runner : public QObject {
     int getCommand();
     bool setCommand(const QString& cmd);
     void setWorkingDirectory(const QString& cwd);
+    void setProgram(const QString& program);
 
  signals:
     void started();
@@ -39,6 +40,7 @@ class Runner : public QObject {
     QProcessEnvironment m_env;
     QProcess m_process;
     QString m_command;
+    QString m_program = "tomb4.exe";
     qint64 m_status;
 };
 
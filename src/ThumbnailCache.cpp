@@ -0,0 +1,238 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ThumbnailCache.hpp"
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QRect>
+#include <QSaveFile>
+#include <cstring>
+#include "picture.hpp"
+
+static constexpr quint32 THUMBNAIL_VERSION = 2;
+
+bool ThumbnailCache::setUpCamp(const QString& levelDir) {
+    bool status = true;
+    const QString path = QString("%1%2%3")
+        .arg(levelDir, QDir::separator(), ".thumbnails");
+
+    QDir cacheDir(path);
+    if (!cacheDir.exists() && !cacheDir.mkpath(path)) {
+        qWarning() << "Failed to create thumbnail directory:" << path;
+        status = false;
+    } else {
+        m_cachePath = cacheDir.absolutePath();
+        // Full RGBA8888 entries of the first version
+        for (const QString& name :
+                cacheDir.entryList(QStringList("*.raw"), QDir::Files)) {
+            (void)cacheDir.remove(name);
+        }
+    }
+    m_ready = status;
+    return status;
+}
+
+const QString ThumbnailCache::entryPath(
+        qint64 pictureId, const QSize& size) const {
+    return QString("%1%2%3_%4x%5.rgb")
+        .arg(m_cachePath, QDir::separator(), QString::number(pictureId))
+        .arg(size.width())
+        .arg(size.height());
+}
+
+QByteArray ThumbnailCache::contentHash(const QByteArray& imageData) {
+    return QCryptographicHash::hash(imageData, QCryptographicHash::Md5);
+}
+
+QImage ThumbnailCache::getImage(
+        qint64 pictureId, const QByteArray& imageData, const QSize& size) {
+    return getImage(pictureId, contentHash(imageData), imageData, size);
+}
+
+QImage ThumbnailCache::getImage(
+        qint64 pictureId, const QByteArray& hash,
+        const QByteArray& imageData, const QSize& size) {
+    QImage image;
+
+    if ((m_ready == false) || (pictureId <= 0) || imageData.isEmpty()) {
+        image = decodeScaledImage(imageData, size);
+    } else {
+        image = findImage(pictureId, hash, size);
+        if (image.isNull() == true) {
+            image = decodeScaledImage(imageData, size);
+            writeImage(entryPath(pictureId, size), hash, image);
+        }
+    }
+    return image;
+}
+
+bool ThumbnailCache::readHeader(
+        const uchar* data, qint64 fileSize, const QByteArray& hash,
+        const QSize& size, ThumbnailHeader* header) const {
+    bool status = false;
+    if ((hash.size() == 16) &&
+            (fileSize >= qint64(sizeof(ThumbnailHeader)))) {
+        (void)memcpy(header, data, sizeof(ThumbnailHeader));
+        status = (strncmp(header->magic.data(), "TRLT", 4) == 0) &&
+            (header->version == THUMBNAIL_VERSION) &&
+            (header->width == quint32(size.width())) &&
+            (header->height == quint32(size.height())) &&
+            (quint64(header->left) + header->columns <= header->width) &&
+            (quint64(header->top) + header->rows <= header->height) &&
+            (fileSize == qint64(sizeof(ThumbnailHeader)) +
+                (qint64(header->columns) * header->rows * 3)) &&
+            (memcmp(header->contentHash.data(), hash.constData(), 16) == 0);
+    }
+    return status;
+}
+
+QImage ThumbnailCache::findImage(
+        qint64 pictureId, const QByteArray& hash, const QSize& size) const {
+    QImage image;
+    QFile* file = new QFile(entryPath(pictureId, size));
+    bool owned = false;
+
+    if ((m_ready == true) &&
+            (file->open(QIODevice::ReadOnly) == true)) {  // flawfinder: ignore
+        const qint64 fileSize = file->size();
+        const uchar* data = file->map(0, fileSize);
+        ThumbnailHeader header;
+        if ((data != nullptr) &&
+                (readHeader(data, fileSize, hash, size, &header) == true)) {
+            const uchar* pixels = data + sizeof(ThumbnailHeader);
+            const int rowSize = int(header.columns) * 3;
+            if ((header.columns == header.width) &&
+                    (header.rows == header.height)) {
+                // The QImage owns the mapping, it is released with the file
+                image = QImage(pixels, size.width(), size.height(), rowSize,
+                    QImage::Format_RGB888,
+                    [](void* info) { delete static_cast<QFile*>(info); },
+                    file);
+                owned = (image.isNull() == false);
+            } else {
+                // Letterboxed, the border stays transparent
+                image = QImage(size, QImage::Format_RGBA8888);
+                image.fill(Qt::transparent);
+                const QImage part = QImage(pixels, header.columns,
+                    header.rows, rowSize, QImage::Format_RGB888)
+                    .convertToFormat(QImage::Format_RGBA8888);
+                for (quint32 y = 0; y < header.rows; y++) {
+                    (void)memcpy(
+                        image.scanLine(header.top + y) + (header.left * 4),
+                        part.constScanLine(y), header.columns * 4);
+                }
+            }
+        }
+    }
+
+    if (owned == false) {
+        delete file;
+    }
+    return image;
+}
+
+bool ThumbnailCache::hasImage(
+        qint64 pictureId, const QByteArray& hash, const QSize& size) const {
+    bool status = false;
+    QFile file(entryPath(pictureId, size));
+
+    // Only the header is read, nothing is mapped
+    if ((m_ready == true) &&
+            (file.open(QIODevice::ReadOnly) == true)) {  // flawfinder: ignore
+        std::array<uchar, sizeof(ThumbnailHeader)> data;
+        ThumbnailHeader header;
+        status = (file.read(reinterpret_cast<char*>(  // flawfinder: ignore
+                data.data()), data.size()) == qint64(data.size())) &&
+            (readHeader(data.data(), file.size(), hash, size,
+                &header) == true);
+    }
+    return status;
+}
+
+qint64 ThumbnailCache::prune(
+        const QSet<qint64>& pictureIds, const QSize& size) const {
+    qint64 removed = 0;
+    const QString suffix =
+        QString("_%1x%2.rgb").arg(size.width()).arg(size.height());
+    QDir cacheDir(m_cachePath);
+    if (m_ready == true) {
+        for (const QString& name : cacheDir.entryList(
+                QStringList("*" + suffix), QDir::Files)) {
+            bool ok = false;
+            const qint64 pictureId =
+                name.chopped(suffix.size()).toLongLong(&ok);
+            if ((ok == true) && (pictureIds.contains(pictureId) == false) &&
+                    (cacheDir.remove(name) == true)) {
+                removed++;
+            }
+        }
+    }
+    return removed;
+}
+
+void ThumbnailCache::writeImage(
+        const QString& path, const QByteArray& hash, const QImage& image) const {
+    const QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+
+    // Only the pixels that are not transparent, as opaque RGB888
+    int left = rgba.width();
+    int top = rgba.height();
+    int right = -1;
+    int bottom = -1;
+    for (int y = 0; y < rgba.height(); y++) {
+        const uchar* row = rgba.constScanLine(y);
+        for (int x = 0; x < rgba.width(); x++) {
+            if (row[(x * 4) + 3] != 0) {
+                left = qMin(left, x);
+                right = qMax(right, x);
+                top = qMin(top, y);
+                bottom = qMax(bottom, y);
+            }
+        }
+    }
+    const QRect covered = (right < 0) ? QRect() :
+        QRect(QPoint(left, top), QPoint(right, bottom));
+    const QImage rgb = rgba.copy(covered)
+        .convertToFormat(QImage::Format_RGB888);
+
+    ThumbnailHeader header;
+    (void)memcpy(header.magic.data(), "TRLT", 4);
+    header.version = THUMBNAIL_VERSION;
+    header.width = rgba.width();
+    header.height = rgba.height();
+    header.left = covered.isEmpty() ? 0 : covered.left();
+    header.top = covered.isEmpty() ? 0 : covered.top();
+    header.columns = covered.isEmpty() ? 0 : covered.width();
+    header.rows = covered.isEmpty() ? 0 : covered.height();
+    (void)memcpy(header.contentHash.data(), hash.constData(), 16);
+
+    QSaveFile file(path);
+    if (file.open(QIODevice::WriteOnly) == true) {  // flawfinder: ignore
+        bool status = (file.write(reinterpret_cast<const char*>(&header),
+                sizeof(ThumbnailHeader)) == qint64(sizeof(ThumbnailHeader)));
+
+        const qint64 rowSize = qint64(header.columns) * 3;
+        for (quint32 y = 0; (y < header.rows) && status; y++) {
+            status = (file.write(reinterpret_cast<const char*>(
+                    rgb.constScanLine(y)), rowSize) == rowSize);
+        }
+
+        if ((status == false) || (file.commit() == false)) {
+            qWarning() << "Failed to write thumbnail:" << path;
+        }
+    } else {
+        qWarning() << "Failed to open thumbnail for writing:" << path;
+    }
+}
@@ -0,0 +1,99 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SRC_THUMBNAILCACHE_HPP_
+#define SRC_THUMBNAILCACHE_HPP_
+
+#include <QByteArray>
+#include <QImage>
+#include <QSet>
+#include <QSize>
+#include <QString>
+#include <array>
+
+#pragma pack(push, 1)  // Set 1-byte alignment
+/**
+ * @struct ThumbnailHeader
+ * @brief Header in front of the raw RGB888 rows of a cached thumbnail.
+ *
+ * Only the part of the canvas the picture covers is stored, the rest is
+ * transparent.
+ */
+struct ThumbnailHeader {
+    std::array<char, 4> magic;          // Magic number ("TRLT")
+    quint32 version;                    // Bumped when the layout changes
+    quint32 width;                      // Size of the whole canvas
+    quint32 height;
+    quint32 left;                       // The stored part of the canvas
+    quint32 top;
+    quint32 columns;
+    quint32 rows;
+    std::array<char, 16> contentHash;   // MD5 of the encoded Picture.data
+};
+#pragma pack(pop)
+
+/**
+ * @class ThumbnailCache
+ * @brief Pre-scaled covers and screenshots stored under the level directory.
+ *
+ * Each entry is keyed by `Picture.PictureID` and the size, the MD5 of the
+ * encoded picture is kept in the header. The pixels are stored as RGB888
+ * and only where the picture covers the canvas. A lookup maps the file and
+ * wraps the pixels in a read-only `QImage` without copying when they cover
+ * all of it, otherwise they are copied onto a transparent canvas. When the
+ * picture in the database changes the hash no longer matches and the entry
+ * is rewritten, entries of pictures that are gone are removed by prune().
+ * A mapped image keeps its file open, so hold on to few of them at a time.
+ * Safe to use from the decode pool, entries are written with `QSaveFile`.
+ */
+class ThumbnailCache {
+ public:
+    static ThumbnailCache& getInstance() {
+        // cppcheck-suppress threadsafety-threadsafety
+        static ThumbnailCache instance;
+        return instance;
+    }
+
+    static QByteArray contentHash(const QByteArray& imageData);
+
+    bool setUpCamp(const QString& levelDir);
+    QImage getImage(
+        qint64 pictureId, const QByteArray& imageData, const QSize& size);
+    QImage getImage(
+        qint64 pictureId, const QByteArray& hash,
+        const QByteArray& imageData, const QSize& size);
+    QImage findImage(
+        qint64 pictureId, const QByteArray& hash, const QSize& size) const;
+    bool hasImage(
+        qint64 pictureId, const QByteArray& hash, const QSize& size) const;
+    /**
+     * @brief Remove the entries of this size for pictures not in the set.
+     * @return Number of entries removed.
+     */
+    qint64 prune(const QSet<qint64>& pictureIds, const QSize& size) const;
+
+ private:
+    ThumbnailCache() {}
+    const QString entryPath(qint64 pictureId, const QSize& size) const;
+    bool readHeader(
+        const uchar* data, qint64 fileSize, const QByteArray& hash,
+        const QSize& size, ThumbnailHeader* header) const;
+    void writeImage(
+        const QString& path, const QByteArray& hash, const QImage& image) const;
+
+    QString m_cachePath;
+    bool m_ready = false;
+    Q_DISABLE_COPY(ThumbnailCache)
+};
+
+#endif  // SRC_THUMBNAILCACHE_HPP_
@@ -14,7 +14,6 @@
 #include <algorithm>
 #include "TombRaiderLinuxLauncher.hpp"
 #include "ui_TombRaiderLinuxLauncher.h"
-#include "staticData.hpp"
 // #include "debug.hpp"
 
 TombRaiderLinuxLauncher::TombRaiderLinuxLauncher(QWidget *parent)
@@ -34,7 +33,15 @@ TombRaiderLinuxLauncher::TombRaiderLinuxLauncher(QWidget *parent)
     connect(ui->walkthroughBackButton, SIGNAL(clicked()),
         this, SLOT(backClicked()));
     connect(ui->setOptions, SIGNAL(clicked()), this, SLOT(setOptionsClicked()));
-    connect(ui->listWidgetModds, SIGNAL(itemSelectionChanged()),
+    // The level browser only asks for the rows it shows
+    m_levelModel = new LevelListModel(this);
+    m_levelModel->setCoverSize(ui->listWidgetModds->iconSize());
+    ui->listWidgetModds->setModel(m_levelModel);
+    ui->listWidgetModds->setItemDelegate(
+        new LevelDelegate(m_levelModel, ui->listWidgetModds));
+    ui->listWidgetModds->setUniformItemSizes(true);
+    connect(ui->listWidgetModds->selectionModel(),
+        SIGNAL(selectionChanged(QItemSelection, QItemSelection)),
         this, SLOT(onListItemSelected()));
 
     // Settings tab
@@ -55,6 +62,11 @@ TombRaiderLinuxLauncher::TombRaiderLinuxLauncher(QWidget *parent)
     connect(&Controller::getInstance(),
         SIGNAL(controllerGenerateList(const QList<int>&)),
         this, SLOT(generateList(const QList<int>&)));
+    connect(&Controller::getInstance(),
+        SIGNAL(controllerListBatch(const QVector<ListItemData>&)),
+        this, SLOT(appendList(const QVector<ListItemData>&)));
+    connect(&Controller::getInstance(), SIGNAL(controllerListDone()),
+        this, SLOT(listDone()));
 
     // Error signal connections
     connect(&Controller::getInstance(), SIGNAL(controllerDownloadError(int)),
@@ -99,6 +111,23 @@ TombRaiderLinuxLauncher::TombRaiderLinuxLauncher(QWidget *parent)
     filterButton_p->setIcon(arrowDownIcon);
     filterButton_p->setIconSize(QSize(16, 16));
 
+    connect(ui->commandLinkButton, SIGNAL(clicked()),
+        this, SLOT(searchClicked()));
+    connect(ui->lineEditSearch, SIGNAL(returnPressed()),
+        this, SLOT(searchClicked()));
+    connect(ui->lineEditSearch, SIGNAL(textEdited(QString)),
+        this, SLOT(searchEdited(QString)));
+
+    // Index 0 is "- All -", the others are the StaticData IDs
+    connect(ui->comboBoxType, SIGNAL(currentIndexChanged(int)),
+        this, SLOT(filterChanged()));
+    connect(ui->comboBoxClass, SIGNAL(currentIndexChanged(int)),
+        this, SLOT(filterChanged()));
+    connect(ui->comboBoxDifficulty, SIGNAL(currentIndexChanged(int)),
+        this, SLOT(filterChanged()));
+    connect(ui->comboBoxDuration, SIGNAL(currentIndexChanged(int)),
+        this, SLOT(filterChanged()));
+
     connect(ui->radioButtonLevelName, &QRadioButton::clicked,
             this, &TombRaiderLinuxLauncher::sortByTitle);
     connect(ui->radioButtonAuthor, &QRadioButton::clicked,
@@ -124,204 +153,124 @@ TombRaiderLinuxLauncher::TombRaiderLinuxLauncher(QWidget *parent)
 }
 
 void TombRaiderLinuxLauncher::generateList(const QList<int>& availableGames) {
-    ui->listWidgetModds->clear();
-    const QString pictures = ":/pictures/";
-    OriginalGameData pictueData;
-
-    foreach(const int &id, availableGames) {
-        // debugStop(QString("%1").arg(id));
-        int IdPositive;
-        bool linkedGameDir;
-        if (id < 0) {
-            linkedGameDir = false;
-            IdPositive = id*(-1);
-        } else {
-            linkedGameDir = true;
-            IdPositive = id;
-        }
-        // debugStop();
-        // Picture and title
-        QString iconPath = pictures + pictueData.getPicture(IdPositive);
-        QString itemName =
-            QString("Tomb Raider %1 Original")
-                .arg(pictueData.romanNumerals[IdPositive]);
-
-        qDebug() << "iconPath :" << iconPath;
-        qDebug() << "itemName :" << itemName;
-        QListWidgetItem *wi = new QListWidgetItem(QIcon(iconPath), itemName);
-        wi->setData(Qt::UserRole, QVariant(IdPositive*(-1)));
-        wi->setData(Qt::UserRole + 1, QVariant(linkedGameDir));
-        ui->listWidgetModds->addItem(wi);
-        originalGamesSet_m.insert(wi);
-        originalGamesList_m.append(wi);
-    }
-
-    StaticData staticData;
-    auto mapType = staticData.getType();
-    auto mapClass = staticData.getClass();
-    auto mapDifficulty = staticData.getDifficulty();
-    auto mapDuration = staticData.getDuration();
-
-    QVector<ListItemData> list;
-    controller.getList(&list);
-    const qint64 s = list.size();
-    for (qint64 i = 0; i < s; i++) {
-        QString tag = QString("%1 by %2\n")
-                          .arg(list[i].m_title)
-                          .arg(list[i].m_author);
-
-        tag += QString(
-                "Type: %1\nClass: %2\nDifficulty: %3\nDuration: %4\nDate:%5")
-                   .arg(mapType.at(list[i].m_type))
-                   .arg(mapClass.at(list[i].m_class))
-                   .arg(mapDifficulty.at(list[i].m_difficulty))
-                   .arg(mapDuration.at(list[i].m_duration))
-                   .arg(list[i].m_releaseDate);
-
-        QListWidgetItem *wi =
-            new QListWidgetItem(list[i].m_picture, tag);
-
-        wi->setData(Qt::UserRole, QVariant(i + 1));
-        QVariantMap itemData;
-        itemData["title"] = list[i].m_title;
-        itemData["author"] = list[i].m_author;
-        itemData["type"] = list[i].m_type;
-        itemData["class_"] = list[i].m_class;
-        itemData["releaseDate"] = list[i].m_releaseDate;
-        itemData["difficulty"] = list[i].m_difficulty;
-        itemData["duration"] = list[i].m_duration;
-        // qDebug() << itemData << Qt::endl;
-        wi->setData(Qt::UserRole + 1, itemData);
-        ui->listWidgetModds->addItem(wi);
-    }
-    sortByTitle();
+    m_levelModel->setOriginalGames(availableGames);
 }
 
-void TombRaiderLinuxLauncher::sortItems(
-    std::function<bool(QListWidgetItem*, QListWidgetItem*)> compare) {
-    QList<QListWidgetItem*> items;
+void TombRaiderLinuxLauncher::appendList(const QVector<ListItemData>& list) {
+    m_levelModel->appendLevels(list);
+}
 
-    // Step 1: Extract items from the QListWidget
-    if (ui->checkBoxOriginalFirst->isChecked() == true) {
-        for (int i = 0; i < ui->listWidgetModds->count(); ++i) {
-            QListWidgetItem* item = ui->listWidgetModds->item(i);
-            // Append the item only if it's not in originalGamesSet_m
-            if (!originalGamesSet_m.contains(item)) {
-                items.append(item);
-            }
-        }
+void TombRaiderLinuxLauncher::listDone() {
+    // Sent for the snapshot and again after the refresh, keep the order
+    // and the search picked in between
+    if (m_levelModel->searching() == true) {
+        m_levelModel->searchAgain();
     } else {
-        for (int i = 0; i < ui->listWidgetModds->count(); ++i) {
-            items.append(ui->listWidgetModds->item(i));
-        }
+        sortByChecked();
     }
-
-    // Step 2: Sort the items using the provided comparison lambda
-    std::sort(items.begin(), items.end(), compare);
-
-    // Step 3: Adjust the position of each item without clearing the list
-    qint64 originalGamesSize =
-        ui->checkBoxOriginalFirst->isChecked() ? originalGamesList_m.size() : 0;
-
-    qint64 size = originalGamesSize + items.size();
-    for (qint64 i = 0; i < size; ++i) {
-        QListWidgetItem* item;
-        if (i < originalGamesSize) {
-            // Handle originalGamesList_m items
-            item = ui->listWidgetModds->takeItem(
-                    ui->listWidgetModds->row(originalGamesList_m[i]));
-            ui->listWidgetModds->insertItem(i, item);
-        } else {
-            // Handle items list
-            item = ui->listWidgetModds->takeItem(
-                    ui->listWidgetModds->row(items[i - originalGamesSize]));
-            ui->listWidgetModds->insertItem(i, item);
-        }
-    }
-}
-
-bool compareTitles(QListWidgetItem* a, QListWidgetItem* b) {
-    const QVariantMap aData = a->data(Qt::UserRole + 1).toMap();
-    const QVariantMap bData = b->data(Qt::UserRole + 1).toMap();
-
-    return aData.value("title").toString().toLower()
-        < bData.value("title").toString().toLower();
+    // Covers that were missing from the thumbnail cache may be there now
+    m_levelModel->refreshCovers();
 }
 
-bool compareAuthors(QListWidgetItem* a, QListWidgetItem* b) {
-    const QVariantMap aData = a->data(Qt::UserRole + 1).toMap();
-    const QVariantMap bData = b->data(Qt::UserRole + 1).toMap();
-    return aData.value("author").toString().toLower()
-        < bData.value("author").toString().toLower();
+void TombRaiderLinuxLauncher::sortItems(LevelStore::Column column) {
+    // The original games have no keys, they sort as the lowest value
+    // unless they are wanted first
+    const bool originalFirst =
+        (ui->checkBoxOriginalFirst->isChecked() == true) ||
+        (LevelStore::descending(column) == false);
+    m_levelModel->sort(column, originalFirst);
 }
 
-bool compareDifficulties(QListWidgetItem* a, QListWidgetItem* b) {
-    const QVariantMap aData = a->data(Qt::UserRole + 1).toMap();
-    const QVariantMap bData = b->data(Qt::UserRole + 1).toMap();
-    return aData.value("difficulty").toInt()
-        > bData.value("difficulty").toInt();
+void TombRaiderLinuxLauncher::sortByTitle() {
+    sortItems(LevelStore::Title);
 }
 
-bool compareDurations(QListWidgetItem* a, QListWidgetItem* b) {
-    const QVariantMap aData = a->data(Qt::UserRole + 1).toMap();
-    const QVariantMap bData = b->data(Qt::UserRole + 1).toMap();
-    return aData.value("duration").toInt()
-        > bData.value("duration").toInt();
+void TombRaiderLinuxLauncher::sortByAuthor() {
+    sortItems(LevelStore::Author);
 }
 
-bool compareClasses(QListWidgetItem* a, QListWidgetItem* b) {
-    const QVariantMap aData = a->data(Qt::UserRole + 1).toMap();
-    const QVariantMap bData = b->data(Qt::UserRole + 1).toMap();
-    return aData.value("class_").toInt()
-        > bData.value("class_").toInt();
+void TombRaiderLinuxLauncher::sortByDifficulty() {
+    sortItems(LevelStore::Difficulty);
 }
 
-bool compareTypes(QListWidgetItem* a, QListWidgetItem* b) {
-    const QVariantMap aData = a->data(Qt::UserRole + 1).toMap();
-    const QVariantMap bData = b->data(Qt::UserRole + 1).toMap();
-    return aData.value("type").toInt()
-        > bData.value("type").toInt();
+void TombRaiderLinuxLauncher::sortByDuration() {
+    sortItems(LevelStore::Duration);
 }
 
-bool compareReleaseDates(QListWidgetItem* a, QListWidgetItem* b) {
-    const QVariantMap aData = a->data(Qt::UserRole + 1).toMap();
-    const QVariantMap bData = b->data(Qt::UserRole + 1).toMap();
-
-    const QDate dateA = QDate::fromString(
-        aData.value("releaseDate").toString(), "dd-MMM-yyyy");
-    const QDate dateB = QDate::fromString(
-        bData.value("releaseDate").toString(), "dd-MMM-yyyy");
-
-    return dateA > dateB;  // descending order
+void TombRaiderLinuxLauncher::sortByClass() {
+    sortItems(LevelStore::Class);
 }
 
-
-void TombRaiderLinuxLauncher::sortByTitle() {
-    sortItems(compareTitles);
+void TombRaiderLinuxLauncher::sortByType() {
+    sortItems(LevelStore::Type);
 }
 
-void TombRaiderLinuxLauncher::sortByAuthor() {
-    sortItems(compareAuthors);
+void TombRaiderLinuxLauncher::sortByReleaseDate() {
+    sortItems(LevelStore::ReleaseDate);
+}
+
+void TombRaiderLinuxLauncher::sortByChecked() {
+    if (ui->radioButtonAuthor->isChecked() == true) {
+        sortByAuthor();
+    } else if (ui->radioButtonDifficulty->isChecked() == true) {
+        sortByDifficulty();
+    } else if (ui->radioButtonDuration->isChecked() == true) {
+        sortByDuration();
+    } else if (ui->radioButtonClass->isChecked() == true) {
+        sortByClass();
+    } else if (ui->radioButtonType->isChecked() == true) {
+        sortByType();
+    } else if (ui->radioButtonReleaseDate->isChecked() == true) {
+        sortByReleaseDate();
+    } else {
+        sortByTitle();
+    }
 }
 
-void TombRaiderLinuxLauncher::sortByDifficulty() {
-    sortItems(compareDifficulties);
-}
+void TombRaiderLinuxLauncher::searchClicked() {
+    const QString text = ui->lineEditSearch->text().trimmed();
 
-void TombRaiderLinuxLauncher::sortByDuration() {
-    sortItems(compareDurations);
+    m_levelModel->cancelSearch();
+    if (text.isEmpty() == true) {
+        m_levelModel->showAll();
+        sortByChecked();
+    } else {
+        // Only the hits are shown, best match first
+        m_levelModel->showOnly(controller.searchLevels(
+            text, ui->comboBoxSearch->currentIndex()));
+    }
 }
 
-void TombRaiderLinuxLauncher::sortByClass() {
-    sortItems(compareClasses);
-}
+void TombRaiderLinuxLauncher::searchEdited(const QString& text) {
+    const QString trimmed = text.trimmed();
 
-void TombRaiderLinuxLauncher::sortByType() {
-    sortItems(compareTypes);
+    if (trimmed.size() >= 3) {
+        m_levelModel->fuzzySearch(
+            trimmed, ui->comboBoxSearch->currentIndex());
+    } else if (m_levelModel->searching() == true) {
+        // Shorter text has too few trigrams, show everything until there
+        // is more or Enter is pressed
+        m_levelModel->cancelSearch();
+        m_levelModel->showAll();
+        sortByChecked();
+    }
 }
 
-void TombRaiderLinuxLauncher::sortByReleaseDate() {
-    sortItems(compareReleaseDates);
+void TombRaiderLinuxLauncher::filterChanged() {
+    FilterQuery query;
+    if (ui->comboBoxType->currentIndex() > 0) {
+        query.types.append(ui->comboBoxType->currentIndex());
+    }
+    if (ui->comboBoxClass->currentIndex() > 0) {
+        query.classes.append(ui->comboBoxClass->currentIndex());
+    }
+    if (ui->comboBoxDifficulty->currentIndex() > 0) {
+        query.difficulties.append(ui->comboBoxDifficulty->currentIndex());
+    }
+    if (ui->comboBoxDuration->currentIndex() > 0) {
+        query.durations.append(ui->comboBoxDuration->currentIndex());
+    }
+    m_levelModel->setFilter(query);
 }
 
 void TombRaiderLinuxLauncher::readSavedSettings() {
@@ -354,10 +303,11 @@ void TombRaiderLinuxLauncher::setup() {
     ui->levelPathEdit->setText(homeDir + l);
 }
 
-void TombRaiderLinuxLauncher::originalSelected(QListWidgetItem *selectedItem) {
-    if (selectedItem != nullptr) {
-        int id = selectedItem->data(Qt::UserRole).toInt();
-        bool linkedGameDir = selectedItem->data(Qt::UserRole + 1).toBool();
+void TombRaiderLinuxLauncher::originalSelected(
+        const QModelIndex& selectedItem) {
+    if (selectedItem.isValid() == true) {
+        int id = selectedItem.data(Qt::UserRole).toInt();
+        bool linkedGameDir = selectedItem.data(Qt::UserRole + 1).toBool();
         // the game directory was a symbolic link and it has a level directory
         if ((linkedGameDir == true) && (controller.getItemState(id) == 1)) {
             ui->pushButtonLink->setEnabled(true);
@@ -370,9 +320,10 @@ void TombRaiderLinuxLauncher::originalSelected(QListWidgetItem *selectedItem) {
     }
 }
 
-void TombRaiderLinuxLauncher::levelDirSelected(QListWidgetItem *selectedItem) {
-    if (selectedItem != nullptr) {
-        int id = selectedItem->data(Qt::UserRole).toInt();
+void TombRaiderLinuxLauncher::levelDirSelected(
+        const QModelIndex& selectedItem) {
+    if (selectedItem.isValid() == true) {
+        int id = selectedItem.data(Qt::UserRole).toInt();
         int state = controller.getItemState(id);
         // Activate or deactivate pushbuttons based on the selected item
         qDebug() << id << Qt::endl;
@@ -402,9 +353,9 @@ void TombRaiderLinuxLauncher::levelDirSelected(QListWidgetItem *selectedItem) {
 }
 
 void TombRaiderLinuxLauncher::onListItemSelected() {
-    QListWidgetItem *selectedItem = ui->listWidgetModds->currentItem();
-    if (selectedItem != nullptr) {
-        int id = selectedItem->data(Qt::UserRole).toInt();
+    const QModelIndex selectedItem = ui->listWidgetModds->currentIndex();
+    if (selectedItem.isValid() == true) {
+        int id = selectedItem.data(Qt::UserRole).toInt();
         if (id < 0) {  // its the original game
             originalSelected(selectedItem);
         } else {
@@ -450,8 +401,8 @@ void TombRaiderLinuxLauncher::setOptionsClicked() {
 }
 
 void TombRaiderLinuxLauncher::linkClicked() {
-    QListWidgetItem *selectedItem = ui->listWidgetModds->currentItem();
-    int id = selectedItem->data(Qt::UserRole).toInt();
+    const QModelIndex selectedItem = ui->listWidgetModds->currentIndex();
+    int id = selectedItem.data(Qt::UserRole).toInt();
     if (m_settings.value(QString("level%1/RunnerType").arg(id)) == 2) {
         Model::getInstance().runWine(id);
     } else {
@@ -470,8 +421,8 @@ void TombRaiderLinuxLauncher::linkClicked() {
 }
 
 void TombRaiderLinuxLauncher::downloadClicked() {
-    QListWidgetItem *selectedItem = ui->listWidgetModds->currentItem();
-    int id = selectedItem->data(Qt::UserRole).toInt();
+    const QModelIndex selectedItem = ui->listWidgetModds->currentIndex();
+    int id = selectedItem.data(Qt::UserRole).toInt();
     if (id < 0) {
         ui->listWidgetModds->setEnabled(false);
         ui->progressBar->setValue(0);
@@ -489,8 +440,8 @@ void TombRaiderLinuxLauncher::downloadClicked() {
 }
 
 void TombRaiderLinuxLauncher::infoClicked() {
-    QListWidgetItem *selectedItem = ui->listWidgetModds->currentItem();
-    int id = selectedItem->data(Qt::UserRole).toInt();
+    const QModelIndex selectedItem = ui->listWidgetModds->currentIndex();
+    int id = selectedItem.data(Qt::UserRole).toInt();
     if (id != 0) {
         InfoData info = controller.getInfo(id);
         ui->infoWebEngineView->setHtml(info.m_body);
@@ -531,8 +482,8 @@ void TombRaiderLinuxLauncher::infoClicked() {
 }
 
 void TombRaiderLinuxLauncher::walkthroughClicked() {
-    QListWidgetItem *selectedItem = ui->listWidgetModds->currentItem();
-    int id = selectedItem->data(Qt::UserRole).toInt();
+    const QModelIndex selectedItem = ui->listWidgetModds->currentIndex();
+    int id = selectedItem.data(Qt::UserRole).toInt();
     if (id != 0) {
         ui->walkthroughWebEngineView->setHtml(controller.getWalkthrough(id));
         ui->walkthroughWebEngineView->show();
@@ -560,13 +511,14 @@ void TombRaiderLinuxLauncher::workTick() {
     ui->progressBar->setValue(value + 1);
     qDebug() << ui->progressBar->value() << "%";
     if (ui->progressBar->value() >= 100) {
-        QListWidgetItem *selectedItem = ui->listWidgetModds->currentItem();
-        int id = selectedItem->data(Qt::UserRole).toInt();
+        const QModelIndex selectedItem = ui->listWidgetModds->currentIndex();
+        int id = selectedItem.data(Qt::UserRole).toInt();
         if (id < 0) {  // its the original game
             ui->pushButtonLink->setEnabled(true);
             ui->pushButtonInfo->setEnabled(false);
             ui->pushButtonDownload->setEnabled(false);
-            selectedItem->setData(Qt::UserRole + 1, QVariant(true));
+            (void)m_levelModel->setData(
+                selectedItem, QVariant(true), Qt::UserRole + 1);
         } else if (id > 0) {  // do not know what to do with 0
             ui->pushButtonLink->setEnabled(true);
             ui->pushButtonInfo->setEnabled(true);
@@ -621,7 +573,7 @@ void TombRaiderLinuxLauncher::GlobalResetClicked() {
 }
 
 void TombRaiderLinuxLauncher::LevelSaveClicked() {
-    int id = ui->listWidgetModds->currentItem()->data(Qt::UserRole).toInt();
+    int id = ui->listWidgetModds->currentIndex().data(Qt::UserRole).toInt();
 
     m_settings.setValue(QString("level%1/CustomCommand")
         .arg(id), ui->lineEditCustomCommand->text());
@@ -27,6 +27,7 @@
 #include <QString>
 
 #include "Controller.hpp"
+#include "LevelListModel.hpp"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class TombRaiderLinuxLauncher; }
@@ -86,6 +87,27 @@ class TombRaiderLinuxLauncher : public QMainWindow {
      * Generates the initial level list after file analysis.
      */
     void generateList(const QList<int>& availableGames);
+    /**
+     * Adds a batch of levels with decoded covers to the list.
+     */
+    void appendList(const QVector<ListItemData>& list);
+    /**
+     * Sorts the list by the checked sort button, or runs the shown search
+     * again, when the last batch has arrived.
+     */
+    void listDone();
+    /**
+     * Shows only the levels matching the search field, best match first.
+     */
+    void searchClicked();
+    /**
+     * Shows the levels with a title or author close to the typed text.
+     */
+    void searchEdited(const QString& text);
+    /**
+     * Shows only the levels in the categories picked in the filter.
+     */
+    void filterChanged();
     /**
      * Sorts the list by author.
      */
@@ -124,11 +146,11 @@ class TombRaiderLinuxLauncher : public QMainWindow {
     /**
      * 
      */
-    void originalSelected(QListWidgetItem *selectedItem);
+    void originalSelected(const QModelIndex& selectedItem);
     /**
      * 
      */
-    void levelDirSelected(QListWidgetItem *selectedItem);
+    void levelDirSelected(const QModelIndex& selectedItem);
     /**
      * Configures game and level directories.
      */
@@ -137,36 +159,19 @@ class TombRaiderLinuxLauncher : public QMainWindow {
      * Loads saved settings.
      */
     void readSavedSettings();
+    /**
+     * Sorts the list again by the checked sort button.
+     */
+    void sortByChecked();
     /**
      * Executes the sorting algorithm.
      */
-    void sortItems(std::function<bool(
-        QListWidgetItem*,
-        QListWidgetItem*)> compare);
+    void sortItems(LevelStore::Column column);
 
-    QSet<QListWidgetItem*> originalGamesSet_m;
-    QList<QListWidgetItem*> originalGamesList_m;
+    LevelListModel* m_levelModel;
     Controller& controller = Controller::getInstance();
     QSettings m_settings;
     Ui::TombRaiderLinuxLauncher *ui;
 };
 
-struct OriginalGameData {
-    QMap<int, QString> romanNumerals = {
-            {0, "null"},
-            {1, "I"},
-            {2, "II"},
-            {3, "III"},
-            {4, "IV"},
-            {5, "V"},
-            {6, "VI"},
-            {7, "IUB"},
-            {8, "IIGM"},
-            {9, "IIILM"},
-    };
-    const QString getPicture(int id) {
-        return QString ("Tomb_Raider_%1.jpg").arg(romanNumerals[id]);
-    }
-};
-
 #endif  // SRC_TOMBRAIDERLINUXLAUNCHER_HPP_
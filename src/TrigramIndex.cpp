@@ -0,0 +1,132 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "TrigramIndex.hpp"
+#include <algorithm>
+
+// Every level is two documents, 2 * n is the title and 2 * n + 1 the author
+
+QVector<quint64> TrigramIndex::trigrams(const QString& text) {
+    const QString folded = text.normalized(QString::NormalizationForm_KD)
+        .toCaseFolded();
+    QVector<quint64> result;
+    QVector<ushort> word;
+
+    auto addWord = [&result, &word]() {
+        if (word.isEmpty() == false) {
+            word.prepend(' ');
+            word.append(' ');
+            for (qint64 i = 0; i + 2 < word.size(); i++) {
+                result.append((quint64(word[i]) << 32) |
+                    (quint64(word[i + 1]) << 16) | quint64(word[i + 2]));
+            }
+            word.clear();
+        }
+    };
+
+    for (const QChar& c : folded) {
+        if (c.isLetterOrNumber() == true) {
+            word.append(c.unicode());
+        } else if (c.isMark() == false) {
+            addWord();
+        }
+    }
+    addWord();
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+void TrigramIndex::clear() {
+    QWriteLocker locker(&m_lock);
+    m_postings.clear();
+    m_ids.clear();
+    m_sizes.clear();
+}
+
+void TrigramIndex::add(
+        qint64 id, const QString& title, const QString& author) {
+    const QVector<quint64> titleTrigrams = trigrams(title);
+    const QVector<quint64> authorTrigrams = trigrams(author);
+
+    QWriteLocker locker(&m_lock);
+    const qint32 document = m_ids.size() * 2;
+    m_ids.append(id);
+    m_sizes.append(titleTrigrams.size());
+    m_sizes.append(authorTrigrams.size());
+    for (const quint64 trigram : titleTrigrams) {
+        m_postings[trigram].append(document);
+    }
+    for (const quint64 trigram : authorTrigrams) {
+        m_postings[trigram].append(document + 1);
+    }
+}
+
+QVector<qint64> TrigramIndex::search(const QString& text, int field,
+        const QAtomicInt* generation, int expected) const {
+    const QVector<quint64> query = trigrams(text);
+    QVector<qint64> result;
+    bool cancelled = false;
+
+    QReadLocker locker(&m_lock);
+    QVector<qint32> hits(m_sizes.size(), 0);
+    QVector<qint32> touched;
+
+    for (const quint64 trigram : query) {
+        cancelled = (generation->loadAcquire() != expected);
+        if (cancelled == true) {
+            break;
+        }
+        auto it = m_postings.constFind(trigram);
+        if (it != m_postings.constEnd()) {
+            for (const qint32 document : it.value()) {
+                if ((document % 2) == field) {
+                    if (hits[document] == 0) {
+                        touched.append(document);
+                    }
+                    hits[document]++;
+                }
+            }
+        }
+    }
+
+    if (cancelled == false) {
+        // Half of the typed trigrams must be there, the rest may be typos
+        const qint32 needed = qMax<qint32>(1, (query.size() + 1) / 2);
+        QVector<qint32> found;
+        for (const qint32 document : touched) {
+            if (hits[document] >= needed) {
+                found.append(document);
+            }
+        }
+
+        // Most shared trigrams first, then the shortest text
+        std::sort(found.begin(), found.end(),
+            [this, &hits](qint32 a, qint32 b) {
+                if (hits[a] != hits[b]) {
+                    return hits[a] > hits[b];
+                }
+                if (m_sizes[a] != m_sizes[b]) {
+                    return m_sizes[a] < m_sizes[b];
+                }
+                return a < b;
+            });
+
+        result.reserve(found.size());
+        for (const qint32 document : found) {
+            result.append(m_ids[document / 2]);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,61 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SRC_TRIGRAMINDEX_HPP_
+#define SRC_TRIGRAMINDEX_HPP_
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+#include <QVector>
+
+/**
+ * @class TrigramIndex
+ * @brief Fuzzy lookup of level titles and authors by shared trigrams.
+ *
+ * Text is case folded, accents are dropped and every word is padded with
+ * a space on both sides before it is cut into trigrams, so "eternl"
+ * still shares most of its trigrams with "eternal". Levels can be added
+ * while searches run on another thread.
+ */
+class TrigramIndex {
+ public:
+    void clear();
+    /**
+     * @brief Index the title and author of a level.
+     */
+    void add(qint64 id, const QString& title, const QString& author);
+    /**
+     * @brief Find levels sharing at least half the trigrams of the text.
+     * @param[in] text What the user has typed so far.
+     * @param[in] field 0 searches titles, 1 authors.
+     * @param[in] generation Search counter, checked while searching.
+     * @param[in] expected Stop and return nothing once generation differs.
+     * @return Level ids, most shared trigrams first.
+     */
+    QVector<qint64> search(const QString& text, int field,
+        const QAtomicInt* generation, int expected) const;
+    /**
+     * @brief The distinct trigrams of a text, sorted.
+     */
+    static QVector<quint64> trigrams(const QString& text);
+
+ private:
+    mutable QReadWriteLock m_lock;
+    QHash<quint64, QVector<qint32>> m_postings;  // Trigram to documents
+    QVector<qint64> m_ids;                       // Level of each document / 2
+    QVector<qint32> m_sizes;                     // Trigrams per document
+};
+
+#endif  // SRC_TRIGRAMINDEX_HPP_
@@ -0,0 +1,417 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ZipStream.hpp"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <cstring>
+#include "ObjectStore.hpp"
+
+static constexpr quint32 LOCAL_HEADER = 0x04034b50;
+static constexpr quint32 DATA_DESCRIPTOR = 0x08074b50;
+static constexpr quint32 CENTRAL_HEADER = 0x02014b50;
+static constexpr quint32 END_OF_CENTRAL = 0x06054b50;
+static constexpr quint32 END_OF_CENTRAL64 = 0x06064b50;
+static constexpr quint16 FLAG_ENCRYPTED = 0x0001;
+static constexpr quint16 FLAG_DESCRIPTOR = 0x0008;
+
+static quint16 read16(const uchar* p) {
+    return quint16(p[0] | (p[1] << 8));
+}
+
+static quint32 read32(const uchar* p) {
+    return quint32(p[0]) | (quint32(p[1]) << 8) |
+        (quint32(p[2]) << 16) | (quint32(p[3]) << 24);
+}
+
+static quint64 read64(const uchar* p) {
+    return quint64(read32(p)) | (quint64(read32(p + 4)) << 32);
+}
+
+ZipStream::ZipStream(const QString& outputPath)
+        : m_root(QDir::cleanPath(outputPath)), m_output(64 * 1024, '\0') {
+    (void)memset(&m_inflate, 0, sizeof(m_inflate));
+}
+
+ZipStream::~ZipStream() {
+    if (m_inflating == true) {
+        (void)mz_inflateEnd(&m_inflate);
+    }
+}
+
+qint64 ZipStream::available() const {
+    return m_buffer.size() - m_offset;
+}
+
+const uchar* ZipStream::at(qint64 offset) const {
+    return reinterpret_cast<const uchar*>(m_buffer.constData()) +
+        m_offset + offset;
+}
+
+void ZipStream::fail(const QString& reason) {
+    qWarning() << "Streaming unzip stopped:" << reason;
+    if (m_inflating == true) {
+        (void)mz_inflateEnd(&m_inflate);
+        m_inflating = false;
+    }
+    m_match.reset();
+    m_file.close();
+    m_buffer.clear();
+    m_offset = 0;
+    m_state = State::Failed;
+}
+
+bool ZipStream::feed(const char* data, qint64 size) {
+    if (m_state == State::Central) {
+        m_central.append(data, size);
+    } else if (m_state != State::Failed) {
+        m_buffer.append(data, size);
+        bool progress = true;
+        while (progress == true) {
+            if (m_state == State::Header) {
+                progress = readHeader();
+            } else if (m_state == State::Data) {
+                progress = readData();
+            } else if (m_state == State::Descriptor) {
+                progress = readDescriptor();
+            } else {
+                progress = false;
+            }
+        }
+
+        if (m_state == State::Central) {
+            m_central.append(m_buffer.mid(m_offset));
+            m_buffer.clear();
+        } else {
+            // Only a header or a partial chunk is left over
+            m_buffer.remove(0, m_offset);
+        }
+        m_offset = 0;
+    }
+    return m_state != State::Failed;
+}
+
+bool ZipStream::readHeader() {
+    bool status = false;
+    if (available() >= 4) {
+        const quint32 signature = read32(at(0));
+        if ((signature == CENTRAL_HEADER) ||
+                (signature == END_OF_CENTRAL) ||
+                (signature == END_OF_CENTRAL64)) {
+            m_state = State::Central;
+            status = true;
+        } else if (signature != LOCAL_HEADER) {
+            fail("unexpected record in archive");
+        } else if (available() >= 30) {
+            const uchar* header = at(0);
+            const quint16 nameLength = read16(header + 26);
+            const quint16 extraLength = read16(header + 28);
+            if (available() >= 30 + nameLength + extraLength) {
+                m_flags = read16(header + 6);
+                m_method = read16(header + 8);
+                m_crc = read32(header + 14);
+                m_compressedSize = read32(header + 18);
+                m_size = read32(header + 22);
+                const QString name = QString::fromUtf8(
+                    reinterpret_cast<const char*>(header + 30), nameLength);
+
+                // Zip64 sizes, only the ones set to 0xFFFFFFFF are there
+                m_zip64 = false;
+                const uchar* extra = header + 30 + nameLength;
+                for (int i = 0; i + 4 <= extraLength;
+                        i += 4 + read16(extra + i + 2)) {
+                    const quint16 length = read16(extra + i + 2);
+                    if ((read16(extra + i) == 0x0001) &&
+                            (i + 4 + length <= extraLength)) {
+                        const uchar* field = extra + i + 4;
+                        int used = 0;
+                        m_zip64 = true;
+                        if ((m_size == 0xFFFFFFFF) && (used + 8 <= length)) {
+                            m_size = read64(field + used);
+                            used += 8;
+                        }
+                        if ((m_compressedSize == 0xFFFFFFFF) &&
+                                (used + 8 <= length)) {
+                            m_compressedSize = read64(field + used);
+                        }
+                    }
+                }
+
+                m_offset += 30 + nameLength + extraLength;
+                status = startEntry(name);
+            }
+        }
+    }
+    return status;
+}
+
+bool ZipStream::startEntry(const QString& name) {
+    const QString path = QDir::cleanPath(QString("%1/%2").arg(m_root, name));
+    m_name = name;
+    m_directory = name.endsWith('/');
+    m_consumed = 0;
+    m_written = 0;
+    m_crcNow = MZ_CRC32_INIT;
+    m_match.reset();
+
+    if ((m_flags & FLAG_ENCRYPTED) != 0) {
+        fail("encrypted entry " + name);
+    } else if ((m_method != MZ_DEFLATED) && (m_method != 0)) {
+        fail("unsupported compression in " + name);
+    } else if ((m_method == 0) && ((m_flags & FLAG_DESCRIPTOR) != 0)) {
+        // The end of stored data can not be found without the sizes
+        fail("stored entry without sizes " + name);
+    } else if ((path != m_root) && (path.startsWith(m_root + "/") == false)) {
+        fail("entry outside of the level directory " + name);
+    } else if (m_directory == true) {
+        if (QDir().mkpath(path) == false) {
+            fail("could not create directory " + path);
+        }
+    } else if (QDir().mkpath(QFileInfo(path).path()) == false) {
+        fail("could not create directory for " + path);
+    } else {
+        m_file.setFileName(path);
+        if ((m_flags & FLAG_DESCRIPTOR) == 0) {
+            // Compared with the object store first, written on a difference
+            m_match.reset(new ObjectStore::Match(path, m_size, m_crc));
+            if (m_match->found() == false) {
+                m_match.reset();
+            }
+        }
+        if (m_match == nullptr) {
+            (void)openFile();
+        }
+    }
+
+    if ((m_state != State::Failed) && (m_method == MZ_DEFLATED)) {
+        (void)memset(&m_inflate, 0, sizeof(m_inflate));
+        if (mz_inflateInit2(&m_inflate, -MZ_DEFAULT_WINDOW_BITS) == MZ_OK) {
+            m_inflating = true;
+        } else {
+            fail("could not start inflating " + name);
+        }
+    }
+    if (m_state != State::Failed) {
+        m_state = State::Data;
+    }
+    return m_state != State::Failed;
+}
+
+bool ZipStream::openFile() {
+    // Never write through a link to a shared object
+    if (ObjectStore::accepts(m_file.fileName()) == true) {
+        (void)QFile::remove(m_file.fileName());
+    }
+    if (m_file.open(  // flawfinder: ignore
+            QIODevice::WriteOnly | QIODevice::Truncate) == false) {
+        fail("could not write " + m_file.fileName());
+    }
+    return m_state != State::Failed;
+}
+
+bool ZipStream::unmatch() {
+    // The bytes before the difference come from the object
+    const qint64 matched = qint64(m_match->matched());
+    if ((openFile() == true) && (matched > 0) &&
+            (m_file.write(reinterpret_cast<const char*>(m_match->data()),
+                matched) != matched)) {
+        fail("could not write " + m_file.fileName());
+    }
+    m_match.reset();
+    return m_state != State::Failed;
+}
+
+bool ZipStream::write(const uchar* data, qint64 size) {
+    if (size > 0) {
+        if (m_directory == true) {
+            fail("directory with data " + m_name);
+        } else if ((m_match != nullptr) &&
+                (m_match->compare(data, size) == false)) {
+            (void)unmatch();
+        }
+
+        if (m_state == State::Failed) {
+            // Nothing more is written
+        } else if ((m_match == nullptr) && (m_file.write(
+                reinterpret_cast<const char*>(data), size) != size)) {
+            fail("could not write " + m_file.fileName());
+        } else {
+            m_crcNow = mz_crc32(m_crcNow, data, size_t(size));
+            m_written += size;
+        }
+    }
+    return m_state != State::Failed;
+}
+
+bool ZipStream::readData() {
+    bool status = false;
+    const bool sized = ((m_flags & FLAG_DESCRIPTOR) == 0);
+    qint64 input = available();
+    if (sized == true) {
+        input = qMin<quint64>(input, m_compressedSize - m_consumed);
+    }
+
+    if (m_method == 0) {
+        if (write(at(0), input) == true) {
+            m_offset += input;
+            m_consumed += input;
+            status = (m_consumed == m_compressedSize) ? endEntry() :
+                (input > 0);
+        }
+    } else if (input > 0) {
+        int result = MZ_OK;
+        m_inflate.next_in = at(0);
+        m_inflate.avail_in = quint32(qMin<qint64>(input, 0x7FFFFFFF));
+        const quint32 given = m_inflate.avail_in;
+        do {
+            m_inflate.next_out = reinterpret_cast<uchar*>(m_output.data());
+            m_inflate.avail_out = quint32(m_output.size());
+            result = mz_inflate(&m_inflate, MZ_SYNC_FLUSH);
+            const qint64 produced = m_output.size() - m_inflate.avail_out;
+            if (write(reinterpret_cast<const uchar*>(m_output.constData()),
+                    produced) == false) {
+                result = MZ_STREAM_ERROR;
+            }
+        } while ((result == MZ_OK) &&
+            ((m_inflate.avail_in > 0) || (m_inflate.avail_out == 0)));
+
+        const quint32 consumed = given - m_inflate.avail_in;
+        m_offset += consumed;
+        m_consumed += consumed;
+
+        if (m_state == State::Failed) {
+            status = false;
+        } else if (result == MZ_STREAM_END) {
+            (void)mz_inflateEnd(&m_inflate);
+            m_inflating = false;
+            if (sized == false) {
+                m_state = State::Descriptor;
+                status = true;
+            } else {
+                status = endEntry();
+            }
+        } else if ((result != MZ_OK) && (result != MZ_BUF_ERROR)) {
+            fail("broken deflate data in " + m_name);
+        } else if ((sized == true) && (m_consumed == m_compressedSize)) {
+            fail("deflate data ends early in " + m_name);
+        } else {
+            status = (consumed > 0);
+        }
+    }
+    return status;
+}
+
+bool ZipStream::readDescriptor() {
+    bool status = false;
+    const qint64 sizes = (m_zip64 == true) ? 16 : 8;
+    if (available() >= 4) {
+        // The signature is optional
+        const qint64 skip = (read32(at(0)) == DATA_DESCRIPTOR) ? 4 : 0;
+        if (available() >= skip + 4 + sizes) {
+            const uchar* descriptor = at(skip);
+            m_crc = read32(descriptor);
+            m_compressedSize = (m_zip64 == true) ?
+                read64(descriptor + 4) : read32(descriptor + 4);
+            m_size = (m_zip64 == true) ?
+                read64(descriptor + 12) : read32(descriptor + 8);
+            m_offset += skip + 4 + sizes;
+            status = endEntry();
+        }
+    }
+    return status;
+}
+
+bool ZipStream::endEntry() {
+    if ((m_consumed != m_compressedSize) || (m_written != m_size) ||
+            (m_crcNow != m_crc)) {
+        fail("size or CRC-32 does not match for " + m_name);
+    } else {
+        bool placed = false;
+        if (m_match != nullptr) {
+            // Every byte matched, written out if the link fails
+            placed = m_match->place();
+            if (placed == false) {
+                (void)unmatch();
+            }
+            m_match.reset();
+        }
+        m_file.close();
+        if ((m_state != State::Failed) && (m_directory == false) &&
+                (placed == false)) {
+            ObjectStore::getInstance().add(m_file.fileName(), m_crc);
+        }
+        if (m_state != State::Failed) {
+            m_done.insert(m_name, {m_crc, m_size});
+            m_state = State::Header;
+        }
+    }
+    return m_state != State::Failed;
+}
+
+bool ZipStream::finish() {
+    bool status = false;
+    if (m_state == State::Central) {
+        const uchar* data = reinterpret_cast<const uchar*>(
+            m_central.constData());
+        const qint64 size = m_central.size();
+        qint64 offset = 0;
+        qint64 entries = 0;
+        status = true;
+
+        while ((status == true) && (offset + 46 <= size) &&
+                (read32(data + offset) == CENTRAL_HEADER)) {
+            const uchar* header = data + offset;
+            const quint32 crc = read32(header + 16);
+            quint64 fileSize = read32(header + 24);
+            const quint16 nameLength = read16(header + 28);
+            const quint16 extraLength = read16(header + 30);
+            const quint16 commentLength = read16(header + 32);
+            const qint64 length =
+                46 + nameLength + extraLength + commentLength;
+
+            if (offset + length > size) {
+                status = false;
+            } else {
+                const QString name = QString::fromUtf8(
+                    reinterpret_cast<const char*>(header + 46), nameLength);
+                const uchar* extra = header + 46 + nameLength;
+                for (int i = 0; i + 4 <= extraLength;
+                        i += 4 + read16(extra + i + 2)) {
+                    if ((read16(extra + i) == 0x0001) &&
+                            (fileSize == 0xFFFFFFFF) &&
+                            (i + 12 <= extraLength)) {
+                        fileSize = read64(extra + i + 4);
+                    }
+                }
+                auto it = m_done.constFind(name);
+                status = (it != m_done.constEnd()) &&
+                    (it->crc == crc) && (it->size == fileSize);
+                entries++;
+                offset += length;
+            }
+        }
+
+        status = status && (entries == m_done.size()) &&
+            (offset + 4 <= size) &&
+            ((read32(data + offset) == END_OF_CENTRAL) ||
+                (read32(data + offset) == END_OF_CENTRAL64));
+        if (status == false) {
+            qWarning() << "Central directory does not match the unpacked"
+                << "entries";
+        }
+    } else if (m_state != State::Failed) {
+        qWarning() << "Download ended before the central directory";
+    }
+    return status;
+}
@@ -0,0 +1,109 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SRC_ZIPSTREAM_HPP_
+#define SRC_ZIPSTREAM_HPP_
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <memory>
+#include "ObjectStore.hpp"
+#include "miniz.h"
+
+/**
+ * @class ZipStream
+ * @brief Unpack a zip archive while it is being downloaded.
+ *
+ * Bytes are fed in the order they arrive. Entries are read from their
+ * local file headers, inflated straight to disk and checked against
+ * their CRC-32. Once the central directory starts it is kept, and
+ * finish() checks every entry in it against what was unpacked. Entries
+ * the ObjectStore may have are compared with the object as they inflate
+ * and linked when equal, they are only written from the first
+ * difference.
+ *
+ * Archives that can not be read front to back, like stored entries
+ * with a data descriptor or encrypted entries, make the stream fail.
+ * The downloaded file should then be extracted the usual way.
+ */
+class ZipStream {
+ public:
+    explicit ZipStream(const QString& outputPath);
+    ~ZipStream();
+
+    /**
+     * @brief Unpack what can be unpacked from the next bytes.
+     * @return false once the stream has failed, later bytes are ignored.
+     */
+    bool feed(const char* data, qint64 size);
+    /**
+     * @brief Check the central directory after the last byte.
+     * @return true if every entry in the archive was unpacked and matched.
+     */
+    bool finish();
+
+ private:
+    enum class State {
+        Header,
+        Data,
+        Descriptor,
+        Central,
+        Failed
+    };
+    struct Done {
+        quint32 crc;
+        quint64 size;
+    };
+
+    bool readHeader();
+    bool startEntry(const QString& name);
+    bool readData();
+    bool openFile();
+    bool unmatch();
+    bool write(const uchar* data, qint64 size);
+    bool readDescriptor();
+    bool endEntry();
+    void fail(const QString& reason);
+    qint64 available() const;
+    const uchar* at(qint64 offset) const;
+
+    State m_state = State::Header;
+    QString m_root;
+    QByteArray m_buffer;            // Bytes not parsed yet, from m_offset
+    qint64 m_offset = 0;
+    QByteArray m_central;           // Central directory and its end record
+
+    // The entry being unpacked
+    QString m_name;
+    QFile m_file;
+    bool m_directory = false;
+    std::unique_ptr<ObjectStore::Match> m_match;  // Still equal to it
+    quint16 m_flags = 0;
+    quint16 m_method = 0;
+    bool m_zip64 = false;
+    quint32 m_crc = 0;              // From the header or the descriptor
+    quint64 m_compressedSize = 0;
+    quint64 m_size = 0;
+    quint64 m_consumed = 0;         // Compressed bytes read so far
+    quint64 m_written = 0;
+    mz_ulong m_crcNow = MZ_CRC32_INIT;
+    mz_stream m_inflate;
+    bool m_inflating = false;
+    QByteArray m_output;
+
+    QHash<QString, Done> m_done;
+};
+
+#endif  // SRC_ZIPSTREAM_HPP_
@@ -12,10 +12,20 @@
  */
 
 #include "binary.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <QSaveFile>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <LIEF/LIEF.hpp>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BINARY_X86 1
+#endif
+
+static constexpr quint32 PATCH_JOURNAL_VERSION = 1;
 
 void analyzeImportTable(const std::string& binaryPath) {
     try {
@@ -204,45 +214,249 @@ void readExportTable(const QString &filePath) {
     file.close();
 }
 
+// Offset of the first match at or after from, byte by byte
+static qint64 findPatternScalar(const uchar* data, qint64 size,
+        const uchar* pattern, qint64 length, qint64 from) {
+    qint64 found = -1;
+    for (qint64 i = from; (i + length <= size) && (found < 0); i++) {
+        if ((data[i] == pattern[0]) &&
+                (memcmp(data + i, pattern, length) == 0)) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+#ifdef BINARY_X86
+/*
+ * The first and the last byte of the pattern are compared at 16 or 32
+ * offsets at once, only offsets where both match are compared in full.
+ */
+__attribute__((target("sse2")))
+static qint64 findPatternSse2(const uchar* data, qint64 size,
+        const uchar* pattern, qint64 length) {
+    const __m128i first = _mm_set1_epi8(char(pattern[0]));
+    const __m128i last = _mm_set1_epi8(char(pattern[length - 1]));
+    qint64 found = -1;
+    qint64 i = 0;
+    for (; (found < 0) && (i + length - 1 + 16 <= size); i += 16) {
+        const __m128i a = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(data + i));
+        const __m128i b = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(data + i + length - 1));
+        unsigned mask = unsigned(_mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+        while ((mask != 0) && (found < 0)) {
+            const int bit = __builtin_ctz(mask);
+            if (memcmp(data + i + bit + 1, pattern + 1, length - 2) == 0) {
+                found = i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return (found < 0) ?
+        findPatternScalar(data, size, pattern, length, i) : found;
+}
+
+__attribute__((target("avx2")))
+static qint64 findPatternAvx2(const uchar* data, qint64 size,
+        const uchar* pattern, qint64 length) {
+    const __m256i first = _mm256_set1_epi8(char(pattern[0]));
+    const __m256i last = _mm256_set1_epi8(char(pattern[length - 1]));
+    qint64 found = -1;
+    qint64 i = 0;
+    for (; (found < 0) && (i + length - 1 + 32 <= size); i += 32) {
+        const __m256i a = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(data + i));
+        const __m256i b = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(data + i + length - 1));
+        unsigned mask = unsigned(_mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+        while ((mask != 0) && (found < 0)) {
+            const int bit = __builtin_ctz(mask);
+            if (memcmp(data + i + bit + 1, pattern + 1, length - 2) == 0) {
+                found = i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return (found < 0) ?
+        findPatternScalar(data, size, pattern, length, i) : found;
+}
+#endif  // BINARY_X86
+
+qint64 findPattern(const uchar* data, qint64 size, const QByteArray& pattern) {
+    const uchar* bytes = reinterpret_cast<const uchar*>(pattern.constData());
+    const qint64 length = pattern.size();
+    qint64 found = -1;
+    if ((length == 0) || (length > size)) {
+        found = (length == 0) ? 0 : -1;
+    } else if (length == 1) {
+        const void* at = memchr(data, bytes[0], size_t(size));
+        found = (at == nullptr) ? -1 : (static_cast<const uchar*>(at) - data);
+    } else {
+#ifdef BINARY_X86
+        if (__builtin_cpu_supports("avx2") != 0) {
+            found = findPatternAvx2(data, size, bytes, length);
+        } else {
+            found = findPatternSse2(data, size, bytes, length);
+        }
+#else
+        found = findPatternScalar(data, size, bytes, length, 0);
+#endif
+    }
+    return found;
+}
+
+// Write bytes over a part of a file without touching the rest of it
+static qint64 writeBytes(
+        const QString& path, qint64 offset, const QByteArray& bytes) {
+    qint64 status = 0;
+    const QByteArray name = QFile::encodeName(path);
+    const int fd = ::open(name.constData(),  // flawfinder: ignore
+        O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        qCritical() << "Error opening file for writing!";
+        status = 2;
+    } else {
+        if ((::pwrite(fd, bytes.constData(), bytes.size(), offset) !=
+                bytes.size()) || (::fdatasync(fd) != 0)) {
+            qCritical() << "Error writing to file!";
+            status = 3;
+        }
+        (void)::close(fd);
+    }
+    return status;
+}
+
+static QString journalPath(const QString& path) {
+    return path + ".undo";
+}
+
+// The journal is on disk before the file is changed, so a patch cut short
+// can always be undone
+static bool writePatchJournal(const QString& path, qint64 fileSize,
+        qint64 offset, const QByteArray& before, const QByteArray& after) {
+    PatchJournal journal;
+    (void)memcpy(journal.magic.data(), "TRLP", 4);
+    journal.version = PATCH_JOURNAL_VERSION;
+    journal.fileSize = fileSize;
+    journal.offset = offset;
+    journal.length = before.size();
+
+    QSaveFile file(journalPath(path));
+    return (file.open(QIODevice::WriteOnly) == true) &&  // flawfinder: ignore
+        (file.write(reinterpret_cast<const char*>(&journal),
+            sizeof(PatchJournal)) == qint64(sizeof(PatchJournal))) &&
+        (file.write(before) == before.size()) &&
+        (file.write(after) == after.size()) &&
+        file.commit();
+}
+
 /**
  * @brief Look for a bit pattern that set 16:9 aspect ratio for Tomb Raider 4.
+ *
+ * The file is searched mapped and only the changed bytes are written,
+ * after an undo journal is saved next to it.
  * @param[in] Open file object reference.
  * @retval 0 Success.
  * @retval 1 Pattern was not found in the file.
  * @retval 2 Could not open the file.
  * @retval 3 Could not write to the file.
+ * @retval 4 Could not write the undo journal.
  * @return error qint64.
  */
 qint64 findReplacePattern(QFile* const file) {
     qint64 status = 0;
-    QByteArray fileContent = file->readAll();
-    file->close();
+    const QString path = file->fileName();
+    const qint64 size = file->size();
 
     // Define the pattern to find and replace
-    QByteArray pattern = QByteArray::fromHex("abaaaa3f0ad7a33b");
-    QByteArray replacement = QByteArray::fromHex("398ee33f0ad7a33b");
-
-    // Find the pattern in the file content
-    int index = fileContent.indexOf(pattern);
-    if (index != -1) {
-        // Replace the pattern
-        fileContent.replace(index, pattern.size(), replacement);
-
-        // Reopen the file for writing
-        if (!file->open(QIODevice::WriteOnly)) {  // flawfinder: ignore
-            qCritical() << "Error opening file for writing!";
-            status = 2;
-        } else if (file->write(fileContent) == -1) {
-            qCritical() << "Error writing to file!";
-            status = 3;
-        } else {
+    const QByteArray pattern = QByteArray::fromHex("abaaaa3f0ad7a33b");
+    const QByteArray replacement = QByteArray::fromHex("398ee33f0ad7a33b");
+
+    // Find the pattern in the mapped file content
+    const uchar* data = (size > 0) ? file->map(0, size) : nullptr;
+    const qint64 index = (data != nullptr) ?
+        findPattern(data, size, pattern) : -1;
+    file->close();
+
+    if (index < 0) {
+        qDebug() << "Pattern not found in the file.";
+        status = 1;
+    } else if (writePatchJournal(
+            path, size, index, pattern, replacement) == false) {
+        qCritical() << "Error writing undo journal!";
+        status = 4;
+    } else {
+        status = writeBytes(path, index, replacement);
+        if (status == 0) {
             qDebug() << "Widescreen patch applied successfully!";
         }
+    }
+    return status;
+}
+
+/**
+ * @brief Put back the bytes a patch changed, from its undo journal.
+ * @param[in] File path to the patched file.
+ * @retval 0 Success, or the file was not changed.
+ * @retval 1 There is no valid undo journal.
+ * @retval 2 The file was changed in some other way since.
+ * @retval 3 Could not write to the file.
+ * @return error qint64.
+ */
+qint64 undoPatch(const QString& path) {
+    qint64 status = 1;
+    QFile journalFile(journalPath(path));
+    QByteArray journalData;
+    if (journalFile.open(QIODevice::ReadOnly) == true) {  // flawfinder: ignore
+        journalData = journalFile.readAll();
+        journalFile.close();
+    }
+
+    PatchJournal journal;
+    (void)memset(&journal, 0, sizeof(PatchJournal));
+    if (journalData.size() >= qint64(sizeof(PatchJournal))) {
+        (void)memcpy(&journal, journalData.constData(), sizeof(PatchJournal));
+    }
+    if ((strncmp(journal.magic.data(), "TRLP", 4) == 0) &&
+            (journal.version == PATCH_JOURNAL_VERSION) &&
+            (journalData.size() == qint64(sizeof(PatchJournal)) +
+                (2 * qint64(journal.length)))) {
+        const QByteArray before = journalData.mid(
+            sizeof(PatchJournal), journal.length);
+        const QByteArray after = journalData.mid(
+            sizeof(PatchJournal) + journal.length, journal.length);
+
+        QFile file(path);
+        QByteArray now;
+        if ((file.open(QIODevice::ReadOnly) == true) &&  // flawfinder: ignore
+                (file.size() == journal.fileSize) &&
+                (journal.offset + journal.length <= journal.fileSize)) {
+            const uchar* data = file.map(journal.offset, journal.length);
+            if (data != nullptr) {
+                now = QByteArray(
+                    reinterpret_cast<const char*>(data), journal.length);
+            }
+        }
+        file.close();
+
+        if (now == after) {
+            status = writeBytes(path, journal.offset, before);
+        } else if (now == before) {
+            status = 0;
+        } else {
+            qCritical() << "File does not match its undo journal:" << path;
+            status = 2;
+        }
     } else {
-        qDebug() << "Pattern not found in the file.";
-        status = 1;
+        qCritical() << "No valid undo journal for:" << path;
+    }
+
+    if ((status == 0) && (journalFile.remove() == true)) {
+        qDebug() << "Patch undone:" << path;
     }
-    file->close();
     return status;
 }
 
@@ -70,12 +70,29 @@ struct ExportDirectory {
     quint32 numNamePointers;    // Number of entries in Name Pointer Table
 };
 
+// Undo journal saved next to a file before it is patched, followed by the
+// bytes before and after the patch
+struct PatchJournal {
+    std::array<char, 4> magic;          // Magic number ("TRLP")
+    quint32 version;                    // Bumped when the layout changes
+    qint64 fileSize;                    // Size of the patched file
+    qint64 offset;                      // Where the bytes were changed
+    quint32 length;                     // Number of bytes changed
+};
+
 #pragma pack(pop)
 
 void analyzeImportTable(const std::string& peFilePath);
 void readPEHeader(const QString &filePath);
 void readExportTable(const QString &filePath);
+/**
+ * @brief Offset of the first match of a pattern in memory, or -1.
+ *
+ * Uses AVX2 or SSE2 when the CPU has it.
+ */
+qint64 findPattern(const uchar* data, qint64 size, const QByteArray& pattern);
 qint64 findReplacePattern(QFile* const file);
+qint64 undoPatch(const QString& path);
 qint64 widescreen_set(const QString& path);
 
 #endif  // SRC_BINARY_HPP_
@@ -16,6 +16,7 @@
 #include <QCoreApplication>
 #include <QTest>
 #include "binary.hpp"
+#include "benchmark.hpp"
 #include "test.hpp"
 #else
 #include <QApplication>
@@ -41,22 +42,46 @@ int main(int argc, char *argv[]) {
         "Set widescreen bit on original games, probably not useful for TRLE",
         "PATH"));
 
+    // Add custom -u option to undo the widescreen patch
+    parser.addOption(QCommandLineOption(
+        QStringList {"u", "undo-patch"},
+        "Put back the bytes the widescreen option changed, from PATH.undo",
+        "PATH"));
+
     // Add custom -b option for binary detection
     parser.addOption(QCommandLineOption(
         QStringList {"b", "binary"},
         "Print PE Header Information, to record Tomb Raider and TRLE binaries",
         "PATH"));
 
+    // Add custom -l option for the level list benchmark
+    parser.addOption(QCommandLineOption(
+        QStringList {"l", "list-benchmark"},
+        "Time building the level list from PATH/tombll.db",
+        "PATH"));
+
+    // Add custom -f option for the file batch benchmark
+    parser.addOption(QCommandLineOption(
+        QStringList {"f", "file-benchmark"},
+        "Time writing, renaming and removing small files in PATH",
+        "PATH"));
+
     // Process arguments
     parser.process(app);
 
     // Handle custom -w flag
     if (parser.isSet("widescreen")  == true) {
         status = widescreen_set(parser.value("widescreen"));
+    } else if (parser.isSet("undo-patch")  == true) {
+        status = undoPatch(parser.value("undo-patch"));
     } else if (parser.isSet("binary")  == true) {
         readPEHeader(parser.value("binary"));
         readExportTable(parser.value("binary"));
         analyzeImportTable(parser.value("binary").toStdString());
+    } else if (parser.isSet("list-benchmark")  == true) {
+        status = listBenchmark(parser.value("list-benchmark"));
+    } else if (parser.isSet("file-benchmark")  == true) {
+        status = fileBatchBenchmark(parser.value("file-benchmark"));
     } else {
         // Pass remaining arguments to QTest
         TestTombRaiderLinuxLauncher test;
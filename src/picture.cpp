@@ -0,0 +1,89 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "picture.hpp"
+#include <QDebug>
+#include <QPainter>
+#include <webp/decode.h>
+
+/**
+ * @brief Decode WEBP with libwebp scaling into a region of the canvas.
+ * @retval true The canvas holds the decoded image.
+ * @retval false Not a WEBP image or the decoding failed.
+ */
+static bool decodeWebpInto(const QByteArray& imageData, QImage* canvas) {
+    bool status = false;
+    const uint8_t* data =
+        reinterpret_cast<const uint8_t*>(imageData.constData());
+    const size_t size = static_cast<size_t>(imageData.size());
+    WebPDecoderConfig config;
+
+    if ((WebPInitDecoderConfig(&config) != 0) &&
+            (WebPGetFeatures(data, size, &config.input) == VP8_STATUS_OK)) {
+        const QSize canvasSize = canvas->size();
+        const QSize newSize = QSize(config.input.width, config.input.height)
+            .scaled(canvasSize, Qt::KeepAspectRatio);
+
+        if (newSize.isEmpty() == false) {
+            const qint64 xOffset = (canvasSize.width() - newSize.width()) / 2;
+            const qint64 yOffset =
+                (canvasSize.height() - newSize.height()) / 2;
+            const qint64 stride = canvas->bytesPerLine();
+            uchar* first = canvas->bits() + (yOffset * stride) + (xOffset * 4);
+
+            config.options.use_scaling = 1;
+            config.options.scaled_width = newSize.width();
+            config.options.scaled_height = newSize.height();
+
+            // Write the rows directly into the canvas, offset to the center
+            config.output.colorspace = MODE_RGBA;
+            config.output.is_external_memory = 1;
+            config.output.u.RGBA.rgba = first;
+            config.output.u.RGBA.stride = static_cast<int>(stride);
+            config.output.u.RGBA.size = static_cast<size_t>(
+                canvas->sizeInBytes() - (first - canvas->bits()));
+
+            status = (WebPDecode(data, size, &config) == VP8_STATUS_OK);
+            WebPFreeDecBuffer(&config.output);
+        }
+    }
+    return status;
+}
+
+QImage decodeScaledImage(const QByteArray& imageData, const QSize& targetSize) {
+    QImage canvas(targetSize, QImage::Format_RGBA8888);
+    canvas.fill(Qt::transparent);
+
+    if (decodeWebpInto(imageData, &canvas) == false) {
+        canvas.fill(Qt::transparent);
+        QImage image;
+        if (image.loadFromData(imageData) == true) {
+            const QImage scaledImage = image.scaled(
+                targetSize,
+                Qt::KeepAspectRatio,
+                Qt::SmoothTransformation);
+
+            // QPainter on a QImage is safe outside the GUI thread
+            QPainter painter(&canvas);
+            painter.drawImage(
+                (targetSize.width() - scaledImage.width()) / 2,
+                (targetSize.height() - scaledImage.height()) / 2,
+                scaledImage);
+            painter.end();
+        } else if (imageData.isEmpty() == false) {
+            qDebug() << "Could not decode image of" << imageData.size()
+                     << "bytes";
+        }
+    }
+    return canvas;
+}
@@ -0,0 +1,35 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SRC_PICTURE_HPP_
+#define SRC_PICTURE_HPP_
+
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+
+/**
+ * @brief Decode an image scaled to fit and centered on a transparent canvas.
+ *
+ * WEBP data is decoded by libwebp with scaling turned on, straight into
+ * the canvas buffer at the centered offset. There is no full size
+ * intermediate image and no painter pass. Other formats fall back to
+ * Qt's image readers.
+ *
+ * @param[in] imageData Encoded image, WEBP, JPEG or PNG.
+ * @param[in] targetSize Size of the canvas, the aspect ratio is kept.
+ * @return The canvas, transparent where the image does not cover it.
+ */
+QImage decodeScaledImage(const QByteArray& imageData, const QSize& targetSize);
+
+#endif  // SRC_PICTURE_HPP_
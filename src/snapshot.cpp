@@ -0,0 +1,196 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "snapshot.hpp"
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+#include <cstring>
+#include "ThumbnailCache.hpp"
+
+static constexpr quint32 SNAPSHOT_VERSION = 1;
+
+static void appendString(
+        const QString& value, QVector<QChar>* pool,
+        quint32* offset, quint32* length) {
+    *offset = pool->size();
+    *length = value.size();
+    for (const QChar& c : value) {
+        pool->append(c);
+    }
+}
+
+bool writeListSnapshot(
+        const QString& path,
+        const QFileInfo& database,
+        const QVector<ListItemData>& list) {
+    bool status = false;
+    QVector<SnapshotRecord> records;
+    QVector<QChar> pool;
+    records.reserve(list.size());
+
+    for (const ListItemData& item : list) {
+        SnapshotRecord record;
+        (void)memset(&record, 0, sizeof(SnapshotRecord));
+        record.id = item.m_id;
+        record.type = item.m_type;
+        record.classInput = item.m_class;
+        record.difficulty = item.m_difficulty;
+        record.duration = item.m_duration;
+        record.pictureId = item.m_pictureId;
+        (void)memcpy(record.pictureHash.data(), item.m_pictureHash.constData(),
+            qMin<size_t>(16, item.m_pictureHash.size()));
+        appendString(item.m_title, &pool,
+            &record.titleOffset, &record.titleLength);
+        appendString(item.m_author, &pool,
+            &record.authorOffset, &record.authorLength);
+        appendString(item.m_releaseDate, &pool,
+            &record.releaseOffset, &record.releaseLength);
+        records.append(record);
+    }
+
+    SnapshotHeader header;
+    (void)memcpy(header.magic.data(), "TRLS", 4);
+    header.version = SNAPSHOT_VERSION;
+    header.count = records.size();
+    header.stringsLength = pool.size();
+    header.databaseSize = database.size();
+    header.databaseModified = database.lastModified().toMSecsSinceEpoch();
+
+    QSaveFile file(path);
+    if (file.open(QIODevice::WriteOnly) == true) {  // flawfinder: ignore
+        const qint64 recordsSize =
+            qint64(records.size()) * sizeof(SnapshotRecord);
+        const qint64 poolSize = qint64(pool.size()) * sizeof(QChar);
+        status = (file.write(reinterpret_cast<const char*>(&header),
+                sizeof(SnapshotHeader)) == qint64(sizeof(SnapshotHeader))) &&
+            (file.write(reinterpret_cast<const char*>(records.constData()),
+                recordsSize) == recordsSize) &&
+            (file.write(reinterpret_cast<const char*>(pool.constData()),
+                poolSize) == poolSize) &&
+            file.commit();
+    }
+    if (status == false) {
+        qWarning() << "Failed to write list snapshot:" << path;
+    }
+    return status;
+}
+
+bool readListSnapshot(
+        const QString& path,
+        const QFileInfo& database,
+        QVector<ListItemData>* list,
+        bool* upToDate) {
+    bool status = false;
+    QFile file(path);
+    *upToDate = false;
+
+    if ((file.open(QIODevice::ReadOnly) == true) &&  // flawfinder: ignore
+            (file.size() >= qint64(sizeof(SnapshotHeader)))) {
+        const uchar* data = file.map(0, file.size());
+        SnapshotHeader header;
+        (void)memset(&header, 0, sizeof(SnapshotHeader));
+        if (data != nullptr) {
+            (void)memcpy(&header, data, sizeof(SnapshotHeader));
+        }
+
+        const qint64 expectedSize = qint64(sizeof(SnapshotHeader)) +
+            (qint64(header.count) * sizeof(SnapshotRecord)) +
+            (qint64(header.stringsLength) * sizeof(QChar));
+
+        if ((data != nullptr) &&
+                (strncmp(header.magic.data(), "TRLS", 4) == 0) &&
+                (header.version == SNAPSHOT_VERSION) &&
+                (file.size() == expectedSize)) {
+            const uchar* recordData = data + sizeof(SnapshotHeader);
+            const QChar* pool = reinterpret_cast<const QChar*>(recordData +
+                (qint64(header.count) * sizeof(SnapshotRecord)));
+            ThumbnailCache& cache = ThumbnailCache::getInstance();
+            bool allCards = true;
+
+            list->clear();
+            list->reserve(header.count);
+            status = true;
+            for (quint32 i = 0; (i < header.count) && status; i++) {
+                SnapshotRecord record;
+                (void)memcpy(&record,
+                    recordData + (qint64(i) * sizeof(SnapshotRecord)),
+                    sizeof(SnapshotRecord));
+
+                // Every string must be inside the pool
+                status =
+                    (record.titleOffset + quint64(record.titleLength)
+                        <= header.stringsLength) &&
+                    (record.authorOffset + quint64(record.authorLength)
+                        <= header.stringsLength) &&
+                    (record.releaseOffset + quint64(record.releaseLength)
+                        <= header.stringsLength);
+
+                if (status == true) {
+                    ListItemData item(
+                        record.id,
+                        QString(pool + record.titleOffset, record.titleLength),
+                        QString(pool + record.authorOffset,
+                            record.authorLength),
+                        record.type,
+                        record.classInput,
+                        QString(pool + record.releaseOffset,
+                            record.releaseLength),
+                        record.difficulty,
+                        record.duration,
+                        record.pictureId,
+                        QByteArray());
+                    item.m_pictureHash = QByteArray(
+                        record.pictureHash.data(), 16);
+                    // Covers are loaded by the view when shown, only check
+                    // that they are there
+                    if ((item.m_pictureId > 0) && (allCards == true)) {
+                        allCards = cache.hasImage(item.m_pictureId,
+                            item.m_pictureHash, ListItemData::coverSize());
+                    }
+                    list->append(item);
+                }
+            }
+
+            *upToDate = status && allCards &&
+                (header.databaseSize == database.size()) &&
+                (header.databaseModified ==
+                    database.lastModified().toMSecsSinceEpoch());
+        }
+        file.close();
+    }
+    if (status == false) {
+        list->clear();
+    }
+    return status;
+}
+
+bool sameListItems(
+        const QVector<ListItemData>& a,
+        const QVector<ListItemData>& b) {
+    bool status = (a.size() == b.size());
+    for (qint64 i = 0; (i < a.size()) && status; i++) {
+        status = (a[i].m_id == b[i].m_id) &&
+            (a[i].m_title == b[i].m_title) &&
+            (a[i].m_author == b[i].m_author) &&
+            (a[i].m_type == b[i].m_type) &&
+            (a[i].m_class == b[i].m_class) &&
+            (a[i].m_releaseDate == b[i].m_releaseDate) &&
+            (a[i].m_difficulty == b[i].m_difficulty) &&
+            (a[i].m_duration == b[i].m_duration) &&
+            (a[i].m_pictureId == b[i].m_pictureId) &&
+            (a[i].m_pictureHash == b[i].m_pictureHash);
+    }
+    return status;
+}
@@ -0,0 +1,85 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SRC_SNAPSHOT_HPP_
+#define SRC_SNAPSHOT_HPP_
+
+#include <QFileInfo>
+#include <QString>
+#include <QVector>
+#include <array>
+#include "Data.hpp"
+
+// Snapshot file layout, header, records and then a pool of UTF-16 strings
+#pragma pack(push, 1)  // Set 1-byte alignment
+struct SnapshotHeader {
+    std::array<char, 4> magic;          // Magic number ("TRLS")
+    quint32 version;                    // Bumped when the layout changes
+    quint32 count;                      // Number of records
+    quint32 stringsLength;              // Number of UTF-16 units in the pool
+    qint64 databaseSize;                // tombll.db size when written
+    qint64 databaseModified;            // tombll.db mtime in ms when written
+};
+
+struct SnapshotRecord {
+    qint64 id;
+    qint64 type;
+    qint64 classInput;
+    qint64 difficulty;
+    qint64 duration;
+    qint64 pictureId;
+    std::array<char, 16> pictureHash;   // Key into the ThumbnailCache
+    quint32 titleOffset;
+    quint32 titleLength;
+    quint32 authorOffset;
+    quint32 authorLength;
+    quint32 releaseOffset;
+    quint32 releaseLength;
+};
+#pragma pack(pop)
+
+/**
+ * @brief Write the built level list so the next start can show it at once.
+ * @param[in] path The snapshot file.
+ * @param[in] database The tombll.db the list was built from.
+ * @param[in] list Decoded list items, the pixels stay in the ThumbnailCache.
+ * @return true if the snapshot was written.
+ */
+bool writeListSnapshot(
+    const QString& path,
+    const QFileInfo& database,
+    const QVector<ListItemData>& list);
+
+/**
+ * @brief Map a snapshot and rebuild the list items.
+ * @param[in] path The snapshot file.
+ * @param[in] database The tombll.db in use now.
+ * @param[out] list The list items, covers are left in the cache.
+ * @param[out] upToDate false when tombll.db changed or a card is not cached.
+ * @return true if the snapshot was valid and read.
+ */
+bool readListSnapshot(
+    const QString& path,
+    const QFileInfo& database,
+    QVector<ListItemData>* list,
+    bool* upToDate);
+
+/**
+ * @brief Compare two lists of decoded items record by record.
+ * @return true if they show the same levels in the same order.
+ */
+bool sameListItems(
+    const QVector<ListItemData>& a,
+    const QVector<ListItemData>& b);
+
+#endif  // SRC_SNAPSHOT_HPP_
@@ -0,0 +1,157 @@
+/* TombRaiderLinuxLauncher
+ * Martin Bångens Copyright (C) 2024
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef TEST_BENCHMARK_HPP_
+#define TEST_BENCHMARK_HPP_
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRunnable>
+#include <QTextStream>
+#include <QThreadPool>
+#include "Data.hpp"
+#include "FileBatch.hpp"
+
+/**
+ * @brief Time how long it takes to build the level list.
+ *
+ * Make a synthetic database with database/make_benchmark_database.py
+ * and point this at the directory that holds the tombll.db file.
+ * The query and the cover decoding are timed apart, the decoding both
+ * serially and on a thread pool like the launcher does it.
+ *
+ * @param[in] path Directory with the tombll.db to benchmark.
+ * @retval 0 Success.
+ * @retval 1 Could not open the database.
+ * @return error qint64.
+ */
+inline qint64 listBenchmark(const QString& path) {
+    qint64 status = 0;
+    Data& data = Data::getInstance();
+    QTextStream out(stdout);
+
+    if (data.initializeDatabase(path) == true) {
+        const qint64 rows = data.getListRowCount();
+        QElapsedTimer timer;
+        timer.start();
+        QVector<ListItemData> list = data.getListItems();
+        out << "Read " << list.size() << " of " << rows
+            << " list items in " << timer.elapsed() << " ms" << Qt::endl;
+
+        QVector<ListItemData> serial = list;
+        timer.restart();
+        for (ListItemData& item : serial) {
+            item.decodePicture();
+        }
+        out << "Decoded covers serially in "
+            << timer.elapsed() << " ms" << Qt::endl;
+
+        QThreadPool pool;
+        timer.restart();
+        for (qint64 i = 0; i < list.size(); i += 32) {
+            ListItemData* begin = list.data() + i;
+            ListItemData* end = list.data() + qMin<qint64>(i + 32, list.size());
+            pool.start(QRunnable::create([begin, end]() {
+                for (ListItemData* item = begin; item != end; item++) {
+                    item->decodePicture();
+                }
+            }));
+        }
+        pool.waitForDone();
+        out << "Decoded covers on " << pool.maxThreadCount()
+            << " threads in " << timer.elapsed() << " ms" << Qt::endl;
+        data.releaseDatabase();
+    } else {
+        status = 1;
+    }
+    return status;
+}
+
+/**
+ * @brief Time creating, renaming and removing many small files.
+ *
+ * A level like tree of small files is made under PATH three times, with
+ * QFile and QDir like before, with FileBatch on plain system calls and
+ * with FileBatch on an io_uring. PATH should be on the disk used for
+ * levels, everything made is removed again.
+ *
+ * @param[in] path Directory to make the files in.
+ * @retval 0 Success.
+ * @retval 1 Could not make or remove the files.
+ * @return error qint64.
+ */
+inline qint64 fileBatchBenchmark(const QString& path) {
+    qint64 status = 0;
+    QTextStream out(stdout);
+    const QString root = QDir(path).filePath("fileBatchBenchmark");
+    const int count = 5000;
+
+    QVector<BatchFile> files;
+    QVector<QPair<QString, QString>> moves;
+    for (int i = 0; i < count; i++) {
+        const QString directory = QString("%1/data%2").arg(root).arg(i % 16);
+        files.append({QString("%1/%2.tga").arg(directory).arg(i),
+            QByteArray(512 + ((i * 97) % 8192), char(i))});
+        moves.append(qMakePair(files.last().path,
+            QString("%1/%2.bak").arg(directory).arg(i)));
+    }
+
+    for (int mode = 0; (mode < 3) && (status == 0); mode++) {
+        FileBatch batch(256, mode == 2);
+        const QString name = (mode == 0) ? "Qt" :
+            (batch.usesRing() ? "io_uring" : "plain");
+        for (int i = 0; i < 16; i++) {
+            (void)QDir().mkpath(QString("%1/data%2").arg(root).arg(i));
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        bool ok = true;
+        if (mode == 0) {
+            for (const BatchFile& file : qAsConst(files)) {
+                QFile f(file.path);
+                ok = ok && f.open(  // flawfinder: ignore
+                        QIODevice::WriteOnly) &&
+                    (f.write(file.data) == file.data.size());
+            }
+        } else {
+            ok = batch.writeFiles(files, FileBatch::Sync::None);
+        }
+        const qint64 written = timer.restart();
+
+        if (mode == 0) {
+            for (const auto& move : qAsConst(moves)) {
+                ok = ok && QFile::rename(move.first, move.second);
+            }
+        } else {
+            ok = ok && batch.renameFiles(moves);
+        }
+        const qint64 renamed = timer.restart();
+
+        if (mode == 0) {
+            ok = ok && QDir(root).removeRecursively();
+        } else {
+            ok = ok && batch.removeTree(root);
+        }
+        const qint64 removed = timer.elapsed();
+
+        out << name << ": wrote " << count << " files in " << written
+            << " ms, renamed in " << renamed << " ms, removed in "
+            << removed << " ms" << Qt::endl;
+        status = (ok == true) ? 0 : 1;
+    }
+    return status;
+}
+
+#endif  // TEST_BENCHMARK_HPP_
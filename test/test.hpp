@@ -14,8 +14,20 @@
 #ifndef TEST_TEST_HPP_
 #define TEST_TEST_HPP_
 
+#include <sys/stat.h>
 #include <QtCore>
 #include <QtTest/QtTest>
+#include "Data.hpp"
+#include "binary.hpp"
+#include "FileBatch.hpp"
+#include "FileHashCache.hpp"
+#include "FilterIndex.hpp"
+#include "GameFileTree.hpp"
+#include "LevelStore.hpp"
+#include "Md5Lanes.hpp"
+#include "ObjectStore.hpp"
+#include "TrigramIndex.hpp"
+#include "ZipStream.hpp"
 
 class TestTombRaiderLinuxLauncher : public QObject {
     Q_OBJECT
@@ -28,6 +40,332 @@ class TestTombRaiderLinuxLauncher : public QObject {
     void test2() {
         QVERIFY(1 + 1 == 2);
     }
+
+    void searchExpression() {
+        QCOMPARE(Data::searchExpression("  ", 0), QString());
+        QCOMPARE(Data::searchExpression("lara croft", 0),
+            QString("{title body walkthrough} : (\"lara\"* \"croft\"*)"));
+        QCOMPARE(Data::searchExpression("a\"b OR", 1),
+            QString("author : (\"a\"\"b\"* \"OR\"*)"));
+    }
+
+    void levelStoreSort() {
+        LevelStore store;
+        (void)store.append(ListItemData(
+            1, "beta", "Zed", 1, 2, "01-Jan-2001", 3, 1, 0, QByteArray()));
+        (void)store.append(ListItemData(
+            2, "Alpha", "amy", 2, 2, "15-Mar-2010", 1, 2, 0, QByteArray()));
+        (void)store.append(ListItemData(
+            3, "gamma", "Bob", 1, 1, "", 2, 3, 0, QByteArray()));
+
+        QVector<qint64> rows = {0, 1, 2};
+        store.sort(LevelStore::Title, &rows);
+        QCOMPARE(rows, QVector<qint64>({1, 0, 2}));
+        store.sort(LevelStore::Author, &rows);
+        QCOMPARE(rows, QVector<qint64>({1, 2, 0}));
+        store.sort(LevelStore::ReleaseDate, &rows);
+        QCOMPARE(rows, QVector<qint64>({1, 0, 2}));
+        store.sort(LevelStore::Difficulty, &rows);
+        QCOMPARE(rows, QVector<qint64>({0, 2, 1}));
+    }
+
+    void filterIndexSelect() {
+        FilterIndex index;
+        for (qint64 row = 0; row < 200; row++) {
+            index.add(row, (row < 100) ? 1 : 2, row % 3, row % 4, 1);
+        }
+
+        FilterQuery query;
+        QCOMPARE(index.select(query).count(), qint64(200));
+        query.types = {2};
+        query.classes = {0};
+        const Bitmap some = index.select(query);
+        QCOMPARE(some.rows().first(), qint64(102));
+        QCOMPARE(some.count(), qint64(33));
+        query.difficulties = {1, 3};
+        QCOMPARE(index.select(query).rows().first(), qint64(105));
+        query.durations = {4};
+        QCOMPARE(index.select(query).count(), qint64(0));
+    }
+
+    void trigramSearch() {
+        TrigramIndex index;
+        index.add(1, "Eternal Lara", "Darkness");
+        index.add(2, "Into the Realm of Eternal Darkness", "Sponge");
+        index.add(3, "Return to the Temple", "Eternl");
+        QAtomicInt generation(1);
+        const QVector<qint64> ids =
+            index.search("eternl darknes", 0, &generation, 1);
+        QCOMPARE(ids.size(), 1);
+        QCOMPARE(ids.first(), qint64(2));
+        QCOMPARE(index.search("etern", 1, &generation, 1).first(), qint64(3));
+        QVERIFY(index.search("eternal", 0, &generation, 0).isEmpty());
+    }
+
+    void fileHashCache() {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString path = dir.filePath("tomb.exe");
+        const QString sum = "0123456789abcdef0123456789abcdef";
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));  // flawfinder: ignore
+        (void)file.write("lara");
+        file.close();
+
+        FileHashCache& cache = FileHashCache::getInstance();
+        QVERIFY(cache.setUpCamp(dir.path()));
+        QVERIFY(cache.find(path).isEmpty());
+        cache.insert(path, sum);
+        QVERIFY(cache.save());
+        QVERIFY(cache.setUpCamp(dir.path()));
+        QCOMPARE(cache.find(path), sum);
+
+        QVERIFY(file.open(QIODevice::Append));  // flawfinder: ignore
+        (void)file.write("croft");
+        file.close();
+        QVERIFY(cache.find(path).isEmpty());
+    }
+
+    void md5BatchLanes() {
+        QVector<QByteArray> buffers;
+        std::vector<Md5Input> inputs;
+        for (int i = 0; i < 40; i++) {
+            // Sizes around the block and padding edges, and a few large ones
+            QByteArray buffer((i < 30) ? (i * 5) : (i * 3001), '\0');
+            for (int j = 0; j < buffer.size(); j++) {
+                buffer[j] = char((i * 31) + (j * 7));
+            }
+            buffers.append(buffer);
+        }
+        for (const QByteArray& buffer : buffers) {
+            inputs.push_back({reinterpret_cast<const unsigned char*>(
+                buffer.constData()), size_t(buffer.size())});
+        }
+        for (const int lanes : {1, 4, 8}) {
+            std::vector<Md5Digest> digests(inputs.size());
+            md5Batch(inputs.data(), inputs.size(), digests.data(), lanes);
+            for (size_t i = 0; i < inputs.size(); i++) {
+                QCOMPARE(QByteArray(reinterpret_cast<const char*>(
+                        digests[i].data()), 16),
+                    QCryptographicHash::hash(
+                        buffers[i], QCryptographicHash::Md5));
+            }
+        }
+    }
+
+    void zipStream() {
+        QByteArray text;
+        for (int i = 0; i < 5000; i++) {
+            text += QByteArray::number(i) + " Lara Croft\n";
+        }
+        mz_zip_archive zip;
+        (void)memset(&zip, 0, sizeof(zip));
+        QVERIFY(mz_zip_writer_init_heap(&zip, 0, 0));
+        QVERIFY(mz_zip_writer_add_mem(&zip, "data/", nullptr, 0, 0));
+        QVERIFY(mz_zip_writer_add_mem(&zip, "data/level.txt",
+            text.constData(), text.size(), MZ_BEST_SPEED));
+        QVERIFY(mz_zip_writer_add_mem(&zip, "stored.txt",
+            text.constData(), 100, MZ_NO_COMPRESSION));
+        void* archive = nullptr;
+        size_t archiveSize = 0;
+        QVERIFY(mz_zip_writer_finalize_heap_archive(
+            &zip, &archive, &archiveSize));
+        const QByteArray bytes(static_cast<const char*>(archive),
+            static_cast<int>(archiveSize));
+        (void)mz_zip_writer_end(&zip);
+        mz_free(archive);
+
+        // Fed in odd sized chunks like a download
+        QTemporaryDir dir;
+        ZipStream stream(dir.path());
+        for (int i = 0; i < bytes.size(); i += 777) {
+            QVERIFY(stream.feed(bytes.constData() + i,
+                qMin(777, bytes.size() - i)));
+        }
+        QVERIFY(stream.finish());
+        QFile file(dir.filePath("data/level.txt"));
+        QVERIFY(file.open(QIODevice::ReadOnly));  // flawfinder: ignore
+        QCOMPARE(file.readAll(), text);
+
+        ZipStream truncated(dir.filePath("truncated"));
+        (void)truncated.feed(bytes.constData(), bytes.size() - 10);
+        QVERIFY(truncated.finish() == false);
+    }
+
+    void objectStore() {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QByteArray level = "level data";
+        const quint32 crc = quint32(mz_crc32(MZ_CRC32_INIT,
+            reinterpret_cast<const uchar*>(level.constData()), level.size()));
+        const QString first = dir.filePath("1.TRLE/data.tr4");
+        const QString second = dir.filePath("2.TRLE/data.tr4");
+        QVERIFY(QDir().mkpath(dir.filePath("1.TRLE")));
+        QVERIFY(QDir().mkpath(dir.filePath("2.TRLE")));
+        for (const QString& path : {first, second}) {
+            QFile file(path);
+            QVERIFY(file.open(QIODevice::WriteOnly));  // flawfinder: ignore
+            (void)file.write(level);
+        }
+
+        ObjectStore& store = ObjectStore::getInstance();
+        QVERIFY(store.setUpCamp(dir.path(), true));
+        QVERIFY(ObjectStore::accepts("tomb4.exe") == false);
+        store.add(first, crc);
+        store.add(second, crc);
+        QVERIFY(store.save());
+        QCOMPARE(QFileInfo(first).size(), qint64(level.size()));
+
+        // Both levels and the store share one file
+        struct stat info;
+        QCOMPARE(::stat(QFile::encodeName(first).constData(), &info), 0);
+        QCOMPARE(qint64(info.st_nlink), qint64(3));
+
+        const QString third = dir.filePath("3.TRLE/data.tr4");
+        QVERIFY(QDir().mkpath(dir.filePath("3.TRLE")));
+        QVERIFY(store.setUpCamp(dir.path(), true));
+        const uchar* bytes = reinterpret_cast<const uchar*>(level.constData());
+        QVERIFY(ObjectStore::Match(third, level.size(), crc + 1).found()
+            == false);
+
+        // Same size and CRC-32 is not enough, every byte is compared
+        ObjectStore::Match other(third, level.size(), crc);
+        QVERIFY(other.found());
+        QVERIFY(other.compare(bytes, 5));
+        QVERIFY(other.compare(
+            reinterpret_cast<const uchar*>("DATA!"), 5) == false);
+        QCOMPARE(other.matched(), quint64(5));
+        QVERIFY(other.place() == false);
+        QVERIFY(QFile::exists(third) == false);
+
+        ObjectStore::Match match(third, level.size(), crc);
+        QVERIFY(match.compare(bytes, level.size()));
+        QVERIFY(match.place());
+        QCOMPARE(store.collect(), qint64(0));
+
+        for (const QString& path : {first, second, third}) {
+            QVERIFY(QFile::remove(path));
+        }
+        QCOMPARE(store.collect(), qint64(level.size()));
+        QVERIFY(store.setUpCamp(dir.path(), false));
+    }
+
+    void gameFileTree() {
+        GameFileTree tree(QStringList{
+            "Level/TOMB4.EXE",
+            "Level/Audio/001.wav",
+            "Level/data/title.tr4",
+            "Level/data/level.tr4",
+            "readme.txt",
+        });
+        GameFileTree tomb4(QStringList{"tomb4.exe", "audio", "Data"});
+        GameFileTree tomb3(QStringList{"tomb3.exe", "audio", "data"});
+        QVERIFY(tree.matchesSubtree(&tomb4) == false);
+        QCOMPARE(tree.matchesFromAnyNode(&tomb4), QString("/Level"));
+        QVERIFY(tree.matchesFromAnyNode(&tomb3).isEmpty());
+
+        static constexpr std::array<GamePattern, 3> patterns = {{
+            {{"tomb3.exe", "audio"}},
+            {{"Level/data/title.tr4"}},
+            {{"tomb4.exe", "audio", "data"}},
+        }};
+        static constexpr auto set = compileGamePatterns(patterns);
+        QCOMPARE(set.pathCount, 5);
+        QString path;
+        QCOMPARE(tree.matchPatterns(set, &path), 1);
+        QVERIFY(path.isEmpty());
+    }
+
+    void findGameRoot() {
+        QTemporaryDir dir;
+        for (const QString& directory : {"Level/Audio", "Level/data",
+                "Level/data/textures/deep", "Other/audio"}) {
+            QVERIFY(QDir().mkpath(dir.filePath(directory)));
+        }
+        for (const QString& name : {"Level/TOMB4.EXE", "Other/tomb3.exe"}) {
+            QFile file(dir.filePath(name));
+            QVERIFY(file.open(QIODevice::WriteOnly));  // flawfinder: ignore
+        }
+
+        static constexpr std::array<GamePattern, 2> patterns = {{
+            {{"tomb3.exe", "audio"}},
+            {{"tomb4.exe", "audio", "data"}},
+        }};
+        static constexpr auto set = compileGamePatterns(patterns);
+        QString path;
+        QCOMPARE(GameFileTree::findGameRoot(dir.path(), set, &path), 0);
+        QCOMPARE(path, QString("/Other"));
+        QVERIFY(QDir(dir.filePath("Other")).removeRecursively());
+        QCOMPARE(GameFileTree::findGameRoot(dir.path(), set, &path), 1);
+        QCOMPARE(path, QString("/Level"));
+        QCOMPARE(GameFileTree::findGameRoot(
+            dir.filePath("Level/data"), set, &path), -1);
+        QVERIFY(path.isEmpty());
+    }
+
+    void fileBatch() {
+        for (const bool ring : {false, true}) {
+            QTemporaryDir dir;
+            QVERIFY(QDir().mkpath(dir.filePath("level/data")));
+            FileBatch batch(4, ring);
+            QVector<BatchFile> files;
+            for (int i = 0; i < 10; i++) {
+                files.append({dir.filePath(QString("level/data/%1").arg(i)),
+                    QByteArray(i * 1000, char('a' + i))});
+            }
+            QVERIFY(batch.writeFiles(files, FileBatch::Sync::None));
+            // Written again in groups of four, synced once
+            QVERIFY(batch.writeFiles(files, FileBatch::Sync::End));
+            QVERIFY(batch.renameFiles(
+                {qMakePair(files[3].path, dir.filePath("level/moved"))}));
+            QFile file(dir.filePath("level/moved"));
+            QVERIFY(file.open(QIODevice::ReadOnly));  // flawfinder: ignore
+            QCOMPARE(file.readAll(), files[3].data);
+            file.close();
+
+            QVERIFY(batch.removeFiles({files[4].path}));
+            QVERIFY(batch.removeFiles({files[4].path}) == false);
+            QVERIFY(batch.removeTree(dir.filePath("level")));
+            QVERIFY(QDir(dir.filePath("level")).exists() == false);
+        }
+    }
+
+    void binaryPatch() {
+        QByteArray data(100000, '\0');
+        for (int i = 0; i < data.size(); i++) {
+            data[i] = char((i * 7) % 251);
+        }
+        const QByteArray pattern = QByteArray::fromHex("abaaaa3f0ad7a33b");
+        const QByteArray replacement = QByteArray::fromHex("398ee33f0ad7a33b");
+        data.replace(77777, pattern.size(), pattern);
+        const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+        for (const QByteArray& needle : {pattern, data.mid(5, 1),
+                data.mid(99990, 10), data.mid(31, 40), QByteArray("xyzw")}) {
+            QCOMPARE(findPattern(bytes, data.size(), needle),
+                qint64(data.indexOf(needle)));
+        }
+
+        QTemporaryDir dir;
+        const QString path = dir.filePath("tomb4.exe");
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));  // flawfinder: ignore
+        QCOMPARE(file.write(data), qint64(data.size()));
+        file.close();
+
+        QCOMPARE(widescreen_set(path), qint64(0));
+        QVERIFY(file.open(QIODevice::ReadOnly));  // flawfinder: ignore
+        QByteArray patched = file.readAll();
+        file.close();
+        QCOMPARE(patched.mid(77777, 8), replacement);
+        QCOMPARE(patched.replace(77777, 8, pattern), data);
+        QCOMPARE(widescreen_set(path), qint64(1));
+
+        QCOMPARE(undoPatch(path), qint64(0));
+        QVERIFY(file.open(QIODevice::ReadOnly));  // flawfinder: ignore
+        QCOMPARE(file.readAll(), data);
+        file.close();
+        QCOMPARE(undoPatch(path), qint64(1));
+    }
 };
 
 #endif  // TEST_TEST_HPP_